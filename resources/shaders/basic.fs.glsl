@@ -1,5 +1,24 @@
 #version 430
 
+// Permutation switches, defined per material by Shader::select
+#ifndef HAVE_TEXTURE
+#define HAVE_TEXTURE 0
+#endif
+#ifndef HAVE_BUMP
+#define HAVE_BUMP 0
+#endif
+
+// Lights of a type nobody uses are left out of the light loop
+#ifndef DIRECTIONAL_LIGHTS
+#define DIRECTIONAL_LIGHTS 1
+#endif
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS 1
+#endif
+#ifndef SPOT_LIGHTS
+#define SPOT_LIGHTS 1
+#endif
+
 in vec3 fPosition;
 in vec2 fTexCoord;
 in vec3 fNormal; //Already normalized
@@ -9,9 +28,8 @@ out vec4 FragColor;
 out vec4 FragNormal;
 
 uniform sampler2D uTexture;
-uniform int uHaveTexture;
+uniform sampler2DArray uTextureArray;
 uniform sampler2D uBump;
-uniform int uHaveBump;
 
 uniform vec3 uAmbientLight;
 
@@ -23,34 +41,82 @@ struct LightSource {
   float specularIndex;
   float aperture;
   float intensity;
+  float radius;
+};
+
+layout(std430, binding = 1) readonly buffer LightBlock {
+  LightSource uLights[];
+};
+
+// Per cluster: the number of lights, followed by their indices
+layout(std430, binding = 3) readonly buffer ClusterBlock {
+  uint uClusterLights[];
 };
 
-layout(std430, binding = 1) buffer LightBlock {
-  LightSource uLights[12];
+READONLY_BLOCK(0) MatrixBlock {
+  mat4 uProj;
+  mat4 uView;
 };
 
-layout(std430, binding = 2) buffer MaterialBlock {
+uniform ivec3 uClusterGrid;
+uniform int uClusterStride;
+uniform float uTileSize;
+uniform vec2 uDepthRange;
+
+READONLY_BLOCK(2) MaterialBlock {
   vec3 uAmbient;
   vec3 uDiffuse;
   vec3 uSpecular;
+  int uLayer;
 };
 
+// Finds the cluster this fragment falls in. Must mirror lightcull.cs.glsl
+uint clusterIndex() {
+  float depth = max(-(uView * vec4(fPosition, 1.0)).z, uDepthRange.x);
+  int slice = int(log(depth / uDepthRange.x) / log(uDepthRange.y / uDepthRange.x) * uClusterGrid.z);
+  slice = clamp(slice, 0, uClusterGrid.z - 1);
+
+  ivec2 tile = min(ivec2(gl_FragCoord.xy / uTileSize), uClusterGrid.xy - 1);
+  return uint(tile.x + uClusterGrid.x * (tile.y + uClusterGrid.y * slice));
+}
+
+// Bounded lights fade out smoothly to nothing at their radius. Lights with
+// no radius reach everything.
+float falloff(uint i, float dist) {
+  if (uLights[i].radius <= 0.0) {
+    return 1.0;
+  }
+
+  float f = clamp(1.0 - pow(dist / uLights[i].radius, 4.0), 0.0, 1.0);
+  return f * f;
+}
+
 void main() {
   vec3 texel = vec3(1.0);
 
-  if (uHaveTexture > 0) {
-    texel = texture(uTexture, fTexCoord).xyz;
-  }
+#if HAVE_TEXTURE
+  texel = uLayer < 0
+    ? texture(uTexture, fTexCoord).xyz
+    : texture(uTextureArray, vec3(fTexCoord, uLayer)).xyz;
+#endif
 
   vec3 normal = fNormal;
-  if (uHaveBump > 0) {
-    normal = normalize(fNormal + texture(uBump, fTexCoord).xyz);
-  }
+#if HAVE_BUMP
+  normal = normalize(fNormal + texture(uBump, fTexCoord).xyz);
+#endif
 
   // Initialize the color with the ambient lighting
   vec3 color = (uAmbientLight + uAmbient) * texel;
 
-  for (int i = 0; i < 12; i++) {
+#if DIRECTIONAL_LIGHTS + POINT_LIGHTS + SPOT_LIGHTS > 0
+  // Only the lights binned into this fragment's cluster can reach it
+  uint cluster = clusterIndex() * uint(uClusterStride);
+  uint lightCount = uClusterLights[cluster];
+
+  for (uint n = 0u; n < lightCount; n++) {
+    uint i = uClusterLights[cluster + 1u + n];
+
+    int type = uLights[i].type;
 
     // The direction of incidence of light
     vec3 lightIncidence;
@@ -58,47 +124,46 @@ void main() {
     // There is no attenuation to begin with
     float attenuation = 1.0;
 
-    if (uLights[i].type == 0 || uLights[i].type > 3) { // No light
-      continue;
-
-    } else if (uLights[i].type == 1) { // Directional light
-
-                                       // There is no point of origin, so the incidence is always the
-                                       // reverse of the direction
+    // Only the types this permutation has lights of are compiled in, so a
+    // left out type has no code at all and its lights are skipped
+#if DIRECTIONAL_LIGHTS > 0
+    if (type == 1) { // Directional light
+      // There is no point of origin, so the incidence is always the
+      // reverse of the direction
       lightIncidence = normalize(uLights[i].direction);
-
-    } else { // Light that have a point of origin
-
-             // The direction of incidence is relative to the light source
+    } else
+#endif
+#if POINT_LIGHTS > 0
+    if (type == 2) { // Point light
+      // The direction of incidence is relative to the light source
       lightIncidence = normalize(uLights[i].position - fPosition);
-
-      // Distance to the point of origin
       float dist = distance(uLights[i].position, fPosition);
 
-      if (uLights[i].type == 2) { // Point light
-
-                                  // Point lights attenuate more
-        attenuation = 1.0 / (1.0 + 0.0002 * pow(dist, 2));
-
-      } else if (uLights[i].type == 3) { // Spotlight
-
-                                         // Spot lights attenuate less
-        attenuation = 1.0 / (1.0 + 0.00005 * pow(dist, 2));
-
-        // Angle between the direction of the light and direction
-        // from the light to the surface
-        float angle = abs(dot(
-          normalize(fPosition - uLights[i].position),
-          normalize(uLights[i].direction)));
-
-        // Aplying aperture limit (angle < 1.0 - aperture)
-        angle += uLights[i].aperture;
-
-        // Penumbra
-        angle = min(angle, 1.0);
-        attenuation = pow(angle, 32);
+      // Point lights attenuate more
+      attenuation = 1.0 / (1.0 + 0.0002 * pow(dist, 2)) * falloff(i, dist);
+    } else
+#endif
+#if SPOT_LIGHTS > 0
+    if (type == 3) { // Spotlight
+      lightIncidence = normalize(uLights[i].position - fPosition);
+      float dist = distance(uLights[i].position, fPosition);
 
-      };
+      // Angle between the direction of the light and direction
+      // from the light to the surface
+      float angle = abs(dot(
+        normalize(fPosition - uLights[i].position),
+        normalize(uLights[i].direction)));
+
+      // Aplying aperture limit (angle < 1.0 - aperture)
+      angle += uLights[i].aperture;
+
+      // Penumbra, which replaces the distance attenuation
+      angle = min(angle, 1.0);
+      attenuation = pow(angle, 32) * falloff(i, dist);
+    } else
+#endif
+    { // No light, or a type this permutation leaves out
+      continue;
     }
 
     // Angle between the normal and incidence of light
@@ -126,7 +191,8 @@ void main() {
       color += uLights[i].intensity * attenuation * (diffuse + specular);
     }
   }
+#endif
 
   FragColor = vec4(color, 1.0);
-  FragNormal = vec4(normal / 2 + 0.5, 1.0);
+  FragNormal = vec4(packNormal(normal), 0.0, 1.0);
 }
@@ -0,0 +1,5 @@
+#version 430
+
+// Only counted by occlusion queries, colour and depth writes are masked off
+void main() {
+}
@@ -0,0 +1,19 @@
+#version 430
+
+READONLY_BLOCK(0) MatrixBlock {
+  mat4 uProj;
+  mat4 uView;
+};
+
+uniform mat4 uModel;
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsMax;
+
+// The box as a single strip of 14 vertices. Each mask holds one axis of the
+// corner for every vertex.
+void main() {
+  int bit = 1 << gl_VertexID;
+  vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0);
+  vec3 position = mix(uBoundsMin, uBoundsMax, corner);
+  gl_Position = uProj * uView * uModel * vec4(position, 1.0);
+}
@@ -0,0 +1,5 @@
+#version 430
+
+// Only counted by a query, colour and depth writes are masked off
+void main() {
+}
@@ -0,0 +1,9 @@
+#version 430
+
+// A screen-filling quad on the far plane. With GL_GREATER it passes the
+// depth test exactly where something nearer was drawn.
+const vec2 vtx[4] = { vec2(1.0, 1.0), vec2(-1.0, 1.0), vec2(1.0, -1.0), vec2(-1.0, -1.0) };
+
+void main() {
+  gl_Position = vec4(vtx[gl_VertexID], 1.0, 1.0);
+}
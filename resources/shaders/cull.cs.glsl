@@ -0,0 +1,143 @@
+#version 430
+
+// One invocation per chunk of an object
+layout(local_size_x = 64) in;
+
+struct Chunk {
+  vec4 lo;
+  vec4 hi;
+  uvec4 range; // Index count, first index
+};
+
+struct Command {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+
+layout(std430, binding = 5) readonly buffer ChunkBlock {
+  Chunk uChunks[];
+};
+
+layout(std430, binding = 6) writeonly buffer CommandBlock {
+  Command uCommands[];
+};
+
+uniform mat4 uModel;
+
+// Model space bounds of the whole object
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsMax;
+
+// This frame's transform, for the frustum test
+uniform mat4 uViewProj;
+
+// The previous frame's matrices, which the depth pyramid was built with.
+// Moving objects were drawn there with their previous model matrix.
+uniform mat4 uPrevModel;
+uniform mat4 uPrevView;
+uniform mat4 uPrevProj;
+
+// Nearest and farthest linear depth per texel of the previous frame
+uniform sampler2D uDepthPyramid;
+uniform int uHistory;
+uniform vec2 uDepthRange;
+
+// Whether the object as a whole is hidden, tested once per work group
+shared bool sObjectHidden;
+
+vec3 corner(vec3 lo, vec3 hi, int i) {
+  return mix(lo, hi, vec3(i & 1, (i >> 1) & 1, i >> 2));
+}
+
+bool inFrustum(vec3 lo, vec3 hi) {
+  // Bits of the clip planes every corner is outside of
+  int outside = 63;
+  for (int i = 0; i < 8; i++) {
+    vec4 c = uViewProj * uModel * vec4(corner(lo, hi, i), 1.0);
+    int planes = 0;
+    planes |= c.x < -c.w ? 1 : 0;
+    planes |= c.x > c.w ? 2 : 0;
+    planes |= c.y < -c.w ? 4 : 0;
+    planes |= c.y > c.w ? 8 : 0;
+    planes |= c.z < -c.w ? 16 : 0;
+    planes |= c.z > c.w ? 32 : 0;
+    outside &= planes;
+  }
+
+  return outside == 0;
+}
+
+// Tests against the previous frame only; there is no second pass for chunks
+// that became visible since, which therefore appear a frame late
+bool occluded(vec3 boxLo, vec3 boxHi) {
+  vec2 lo = vec2(1.0);
+  vec2 hi = vec2(0.0);
+  float nearest = uDepthRange.y;
+
+  for (int i = 0; i < 8; i++) {
+    vec4 v = uPrevView * uPrevModel * vec4(corner(boxLo, boxHi, i), 1.0);
+
+    // Boxes crossing the near plane have no usable screen bounds
+    float depth = -v.z;
+    if (depth < uDepthRange.x) {
+      return false;
+    }
+
+    vec4 c = uPrevProj * v;
+    vec2 uv = c.xy / c.w * 0.5 + 0.5;
+    lo = min(lo, uv);
+    hi = max(hi, uv);
+    nearest = min(nearest, depth);
+  }
+
+  lo = clamp(lo, 0.0, 1.0);
+  hi = clamp(hi, 0.0, 1.0);
+
+  // The level at which the box covers at most 2x2 texels
+  ivec2 base = textureSize(uDepthPyramid, 0);
+  vec2 extent = (hi - lo) * vec2(base);
+  int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+  level = min(level, textureQueryLevels(uDepthPyramid) - 1);
+
+  // Levels round down, so texel t covers the level 0 texels from t << level
+  // up to the next texel, and the last row and column also cover the odd
+  // texels left over. Scaling the uv by the level's own size would drift
+  // from that on sizes that aren't powers of two.
+  ivec2 size = textureSize(uDepthPyramid, level);
+  ivec2 a = min(ivec2(lo * vec2(base)) >> level, size - 1);
+  ivec2 b = min(ivec2(hi * vec2(base)) >> level, size - 1);
+
+  float farthest = 0.0;
+  for (int y = a.y; y <= b.y; y++) {
+    for (int x = a.x; x <= b.x; x++) {
+      farthest = max(farthest, texelFetch(uDepthPyramid, ivec2(x, y), level).y);
+    }
+  }
+
+  return nearest > farthest;
+}
+
+void main() {
+  // One test of the object's box hides all of its chunks at once. The CPU
+  // has already dropped objects outside of the frustum.
+  if (gl_LocalInvocationIndex == 0u) {
+    sObjectHidden = uHistory != 0 && occluded(uBoundsMin, uBoundsMax);
+  }
+  barrier();
+
+  uint i = gl_GlobalInvocationID.x;
+  if (i >= uint(uChunks.length())) {
+    return;
+  }
+
+  Chunk chunk = uChunks[i];
+  bool visible = !sObjectHidden
+    && inFrustum(chunk.lo.xyz, chunk.hi.xyz)
+    && !(uHistory != 0 && occluded(chunk.lo.xyz, chunk.hi.xyz));
+
+  // Without an indirect count, hidden chunks are left in place as empty draws
+  uCommands[i] = Command(chunk.range.x, visible ? 1u : 0u, chunk.range.y, 0, 0u);
+}
@@ -5,80 +5,68 @@ out vec4 FragColor;
 uniform sampler2D uFramebuffer;
 uniform sampler2D uDepthbuffer;
 uniform sampler2D uDepth;
-uniform vec2 uScreenSize;
-
-struct LightSource {
-  int type;
-  vec3 direction;
-  vec3 color;
-  vec3 position;
-  float specularIndex;
-  float aperture;
-  float intensity;
-};
-
-layout(std430, binding = 1) buffer LightBlock {
-  LightSource uLights[12];
-};
-
-layout(std430, binding = 2) buffer MaterialBlock {
-  vec3 uAmbient;
-  vec3 uDiffuse;
-  vec3 uSpecular;
-};
-
-const float focus = 5.0f;
-const float cap = 5.0f;
-
-float linearDepth() {
-  float depth = texture(
-    uDepthbuffer,
-    vec2(gl_FragCoord.x / uScreenSize.x, gl_FragCoord.y / uScreenSize.y)).r;
-  return 2.0 * 0.1 * 200.0 / (200.1 - (2.0 * depth - 1.0) * (199.9));
-}
 
-// Fetch a color from the frame buffer with the given offsets
-vec3 textureOffset(int offsetX, int offsetY) {
-  return texture(uFramebuffer,
-                 vec2((gl_FragCoord.x + offsetX) / uScreenSize.x,
-                 (gl_FragCoord.y + offsetY) / uScreenSize.y)).rgb;
-}
-
-void main() {
+// Nearest and farthest linear depth per texel, from half resolution down
+uniform sampler2D uDepthPyramid;
 
-  vec3 currentColor = vec3(0);
-  float weights = 0;
+// Half resolution blur, with the linear depth in alpha
+uniform sampler2D uBlurred;
 
-  // Map the pixel to distance
-  // This generates a rapidly increasing value from a central focal point
-  float depth = abs(linearDepth() - focus);
+// Focal distance and the range over which the blur widens
+uniform vec2 uFocus;
 
-  // Capping off the blurring for a tilt-shift effect
-  if (depth > cap) {
-    depth = cap;
-  }
+uniform vec2 uScreenSize;
 
-  depth = depth / cap - 1.0;
+// Amount of blur below which the sharp frame is used as it is
+const float IN_FOCUS = 0.1;
 
-  float factor;
-  for (int i = -4; i < 5; i++) {
-    for (int j = -4; j < 5; j++) {
+float circleOfConfusion(float depth) {
+  return min(abs(depth - uFocus.x), uFocus.y) / uFocus.y;
+}
 
-      // Fake gaussian - an approxiation I tested on Octave
-      // should work close enough, though much faster
-      // ** Very sensitive!! Only makes since if doing tilt-shifting
-      factor = exp(depth*pow(i, 2)) * exp(depth*pow(j, 2));
+void main() {
+  vec2 uv = gl_FragCoord.xy / uScreenSize;
+  vec3 sharp = texture(uFramebuffer, uv).rgb;
 
-      // Store the current factor into the overall weight
-      weights += factor;
+  // The background is passed through
+  if (texture(uDepthbuffer, uv).r == 1.0) {
+    FragColor = vec4(sharp, 1.0);
+    return;
+  }
 
-      // Apply current weighted color into final color
-      currentColor += textureOffset(i, j) * factor;
-    }
+  // Skip the upsample where the whole 8x8 block around this pixel is in
+  // focus. The blur grows away from the focal plane, so the block's
+  // nearest and farthest depths bound it.
+  vec2 range = textureLod(uDepthPyramid, uv, 2.0).xy;
+  if (max(circleOfConfusion(range.x), circleOfConfusion(range.y)) <= IN_FOCUS) {
+    FragColor = vec4(sharp, 1.0);
+    return;
   }
 
-  // Finalize the weighted average
-  currentColor /= weights;
+  float depth = texture(uDepth, uv).r;
+
+  // Upsample bilinearly, but favour the half resolution texels at a depth
+  // close to this pixel's, so that blur doesn't bleed across silhouettes
+  vec2 coord = uv * vec2(textureSize(uBlurred, 0)) - 0.5;
+  ivec2 base = ivec2(floor(coord));
+  vec2 f = coord - vec2(base);
+  ivec2 last = textureSize(uBlurred, 0) - 1;
+
+  vec3 blurred = vec3(0.0);
+  float total = 0.0;
+  for (int i = 0; i < 4; i++) {
+    ivec2 o = ivec2(i & 1, i >> 1);
+    vec4 texel = texelFetch(uBlurred, clamp(base + o, ivec2(0), last), 0);
+
+    vec2 bilinear = mix(1.0 - f, f, vec2(o));
+    float w = bilinear.x * bilinear.y / (1e-3 + abs(texel.a - depth) / depth);
+    blurred += texel.rgb * w;
+    total += w;
+  }
+  blurred /= max(total, 1e-6);
 
-  FragColor = vec4(currentColor, 1.0);
+  // In focus the sharp frame shows through, since half resolution can't
+  // hold the detail
+  float coc = circleOfConfusion(depth);
+  FragColor = vec4(mix(sharp, blurred, smoothstep(IN_FOCUS, 0.5, coc)), 1.0);
 }
@@ -0,0 +1,32 @@
+#version 430
+
+// One invocation per texel of the level being built
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rg32f, binding = 1) readonly uniform image2D uSource;
+layout(rg32f, binding = 2) writeonly uniform image2D uTarget;
+
+void main() {
+  ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 size = imageSize(uTarget);
+  if (any(greaterThanEqual(p, size))) {
+    return;
+  }
+
+  // Levels round down, so the last row and column also cover the odd texel
+  // of the level above
+  ivec2 last = imageSize(uSource) - 1;
+  ivec2 lo = p * 2;
+  ivec2 hi = ivec2(p.x == size.x - 1 ? last.x : lo.x + 1,
+                   p.y == size.y - 1 ? last.y : lo.y + 1);
+
+  vec2 range = vec2(1e30, -1e30);
+  for (int y = lo.y; y <= hi.y; y++) {
+    for (int x = lo.x; x <= hi.x; x++) {
+      vec2 texel = imageLoad(uSource, min(ivec2(x, y), last)).xy;
+      range = vec2(min(range.x, texel.x), max(range.y, texel.y));
+    }
+  }
+
+  imageStore(uTarget, p, vec4(range, 0.0, 0.0));
+}
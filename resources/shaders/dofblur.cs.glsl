@@ -0,0 +1,59 @@
+#version 430
+
+// One work group per run of 64 texels along the blur direction
+layout(local_size_x = 64) in;
+
+uniform sampler2D uSource;
+layout(rgba16f, binding = 0) writeonly uniform image2D uTarget;
+uniform ivec2 uDirection;
+uniform vec2 uFocus;
+
+const int LEVELS = 16;
+const int RADIUS = 2;
+const int TILE = 64 + 2 * RADIUS;
+
+// Weights for the taps 0, 1 and 2 texels out, per amount of blur
+READONLY_BLOCK(4) KernelBlock {
+  vec4 uWeights[LEVELS];
+};
+
+// The run plus the apron on either side, so each texel is fetched once
+shared vec4 sTile[TILE];
+
+vec3 weights(float depth) {
+  float level = min(abs(depth - uFocus.x), uFocus.y) / uFocus.y * float(LEVELS - 1);
+  int lo = int(level);
+  int hi = min(lo + 1, LEVELS - 1);
+  return mix(uWeights[lo].xyz, uWeights[hi].xyz, level - float(lo));
+}
+
+void main() {
+  ivec2 size = textureSize(uSource, 0);
+  int extent = uDirection.x != 0 ? size.x : size.y;
+  int start = int(gl_WorkGroupID.x * gl_WorkGroupSize.x);
+  int row = int(gl_WorkGroupID.y);
+  int local = int(gl_LocalInvocationID.x);
+
+  for (int i = local; i < TILE; i += int(gl_WorkGroupSize.x)) {
+    int t = clamp(start + i - RADIUS, 0, extent - 1);
+    sTile[i] = texelFetch(uSource, uDirection * t + uDirection.yx * row, 0);
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  int t = start + local;
+  if (t >= extent) {
+    return;
+  }
+
+  vec4 center = sTile[local + RADIUS];
+  vec3 w = weights(center.a);
+
+  vec3 color = center.rgb * w.x;
+  for (int k = 1; k <= RADIUS; k++) {
+    color += w[k] * (sTile[local + RADIUS - k].rgb + sTile[local + RADIUS + k].rgb);
+  }
+
+  imageStore(uTarget, uDirection * t + uDirection.yx * row, vec4(color, center.a));
+}
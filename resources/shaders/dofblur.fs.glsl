@@ -0,0 +1,39 @@
+#version 430
+
+out vec4 FragColor;
+
+uniform sampler2D uSource;
+uniform ivec2 uDirection;
+uniform vec2 uFocus;
+
+const int LEVELS = 16;
+
+// Weights for the taps 0, 1 and 2 texels out, per amount of blur
+READONLY_BLOCK(4) KernelBlock {
+  vec4 uWeights[LEVELS];
+};
+
+vec3 weights(float depth) {
+  float level = min(abs(depth - uFocus.x), uFocus.y) / uFocus.y * float(LEVELS - 1);
+  int lo = int(level);
+  int hi = min(lo + 1, LEVELS - 1);
+  return mix(uWeights[lo].xyz, uWeights[hi].xyz, level - float(lo));
+}
+
+// One direction of the separable blur. The kernel follows the depth of the
+// centre texel, which is passed through in alpha.
+void main() {
+  ivec2 p = ivec2(gl_FragCoord.xy);
+  ivec2 last = textureSize(uSource, 0) - 1;
+
+  vec4 center = texelFetch(uSource, p, 0);
+  vec3 w = weights(center.a);
+
+  vec3 color = center.rgb * w.x;
+  for (int k = 1; k <= 2; k++) {
+    color += w[k] * texelFetch(uSource, clamp(p - uDirection * k, ivec2(0), last), 0).rgb;
+    color += w[k] * texelFetch(uSource, clamp(p + uDirection * k, ivec2(0), last), 0).rgb;
+  }
+
+  FragColor = vec4(color, center.a);
+}
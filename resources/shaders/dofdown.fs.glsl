@@ -0,0 +1,24 @@
+#version 430
+
+out vec4 FragColor;
+
+uniform sampler2D uFramebuffer;
+uniform sampler2D uDepth;
+
+// Averages each 2x2 block of the frame, with the linear depth in alpha.
+// The colour may come from a scaled post-process stage, so it is looked up
+// relative to the linear depth, which is always at full resolution.
+void main() {
+  ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+  ivec2 last = textureSize(uDepth, 0) - 1;
+  vec2 toColor = vec2(textureSize(uFramebuffer, 0)) / vec2(last + 1);
+
+  vec4 sum = vec4(0.0);
+  for (int i = 0; i < 4; i++) {
+    ivec2 p = min(base + ivec2(i & 1, i >> 1), last);
+    sum.rgb += texelFetch(uFramebuffer, ivec2(vec2(p) * toColor), 0).rgb;
+    sum.a += texelFetch(uDepth, p, 0).r;
+  }
+
+  FragColor = sum / 4.0;
+}
@@ -15,25 +15,25 @@ struct LightSource {
   float specularIndex;
   float aperture;
   float intensity;
+  float radius;
 };
 
-layout(std430, binding = 1) buffer LightBlock {
-  LightSource uLights[12];
+layout(std430, binding = 1) readonly buffer LightBlock {
+  LightSource uLights[];
 };
 
-layout(std430, binding = 2) buffer MaterialBlock {
+READONLY_BLOCK(2) MaterialBlock {
   vec3 uAmbient;
   vec3 uDiffuse;
   vec3 uSpecular;
+  int uLayer;
 };
 
 const float cap = 20.0f;
 
+// Linearised once per frame by the depth pyramid pass
 float linearDepth() {
-  float depth = texture(
-    uDepthbuffer,
-    vec2(gl_FragCoord.x / uScreenSize.x, gl_FragCoord.y / uScreenSize.y)).r;
-  return 2.0 * 0.1 * 200.0 / (200.1 - (2.0 * depth - 1.0) * (199.9));
+  return texture(uDepth, gl_FragCoord.xy / uScreenSize).r;
 }
 
 // Fetch a color from the frame buffer with the given offsets
@@ -47,6 +47,12 @@ void main() {
 
   vec3 currentColor = textureOffset(0, 0);
 
+  // The background is passed through
+  if (texture(uDepthbuffer, gl_FragCoord.xy / uScreenSize).r == 1.0) {
+    FragColor = vec4(currentColor, 1.0);
+    return;
+  }
+
   // Map the pixel to distance
   // This generates a rapidly increasing value from a central focal point
   float depth = linearDepth();
@@ -10,9 +10,7 @@ out vec4 FragNormal;
 out float FragDepth;
 
 uniform sampler2D uTexture;
-uniform int uHaveTexture;
 uniform sampler2D uBump;
-uniform int uHaveBump;
 
 uniform vec3 uAmbientLight;
 
@@ -24,16 +22,18 @@ struct LightSource {
   float specularIndex;
   float aperture;
   float intensity;
+  float radius;
 };
 
-layout(std430, binding = 1) buffer LightBlock {
-  LightSource uLights[12];
+layout(std430, binding = 1) readonly buffer LightBlock {
+  LightSource uLights[];
 };
 
-layout(std430, binding = 2) buffer MaterialBlock {
+READONLY_BLOCK(2) MaterialBlock {
   vec3 uAmbient;
   vec3 uDiffuse;
   vec3 uSpecular;
+  int uLayer;
 };
 
 // vec3 hsv2rgb(vec3 c)
@@ -58,6 +58,6 @@ void main()
   }
 
   FragColor = vec4(color, 1.0);
-  FragNormal = vec4(fNormal / 2 + 0.5, 1.0);
+  FragNormal = vec4(packNormal(fNormal), 0.0, 1.0);
   FragDepth = fDepth;
 }
@@ -0,0 +1,119 @@
+#version 430
+
+// One work group per cluster; the invocations split the light list
+layout(local_size_x = 64) in;
+
+struct LightSource {
+  int type;
+  vec3 direction;
+  vec3 color;
+  vec3 position;
+  float specularIndex;
+  float aperture;
+  float intensity;
+  float radius;
+};
+
+layout(std430, binding = 1) readonly buffer LightBlock {
+  LightSource uLights[];
+};
+
+layout(std430, binding = 3) writeonly buffer ClusterBlock {
+  uint uClusterLights[];
+};
+
+READONLY_BLOCK(0) MatrixBlock {
+  mat4 uProj;
+  mat4 uView;
+};
+
+uniform ivec3 uClusterGrid;
+uniform int uClusterStride;
+uniform float uTileSize;
+uniform vec2 uDepthRange;
+uniform vec2 uScreenSize;
+
+shared uint sCount;
+shared vec3 sMin;
+shared vec3 sMax;
+
+// Slices are spaced exponentially, so they stay roughly cubic in view space
+float sliceDepth(uint slice) {
+  return uDepthRange.x * pow(uDepthRange.y / uDepthRange.x,
+                             float(slice) / float(uClusterGrid.z));
+}
+
+void main() {
+  uvec3 id = gl_WorkGroupID;
+  uvec3 grid = uvec3(uClusterGrid);
+  uint stride = uint(uClusterStride);
+  uint cluster = id.x + grid.x * (id.y + grid.y * id.z);
+
+  if (gl_LocalInvocationIndex == 0) {
+    sCount = 0u;
+
+    // Tile corners in NDC
+    vec2 lo = vec2(id.xy) * uTileSize / uScreenSize * 2.0 - 1.0;
+    vec2 hi = min(vec2(id.xy + 1u) * uTileSize / uScreenSize, 1.0) * 2.0 - 1.0;
+    vec2 corners[4] = { lo, vec2(hi.x, lo.y), vec2(lo.x, hi.y), hi };
+
+    float depths[2] = { sliceDepth(id.z), sliceDepth(id.z + 1u) };
+
+    // Intersect the rays through each corner with the slice's planes. Using
+    // the near and far points of the ray works for orthographic projections
+    // too.
+    mat4 invProj = inverse(uProj);
+    vec3 boxMin = vec3(1e30);
+    vec3 boxMax = vec3(-1e30);
+    for (int c = 0; c < 4; c++) {
+      vec4 a = invProj * vec4(corners[c], -1.0, 1.0);
+      vec4 b = invProj * vec4(corners[c], 1.0, 1.0);
+      a /= a.w;
+      b /= b.w;
+
+      for (int d = 0; d < 2; d++) {
+        float t = (-depths[d] - a.z) / (b.z - a.z);
+        vec3 p = mix(a.xyz, b.xyz, t);
+        boxMin = min(boxMin, p);
+        boxMax = max(boxMax, p);
+      }
+    }
+
+    sMin = boxMin;
+    sMax = boxMax;
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  uint lightCount = uint(uLights.length());
+  for (uint i = gl_LocalInvocationIndex; i < lightCount; i += gl_WorkGroupSize.x) {
+    int type = uLights[i].type;
+    if (type == 0 || type > 3) { // No light
+      continue;
+    }
+
+    // Directional and unbounded lights reach every cluster
+    bool visible = true;
+    float radius = uLights[i].radius;
+    if (type != 1 && radius > 0.0) {
+      vec3 center = (uView * vec4(uLights[i].position, 1.0)).xyz;
+      vec3 delta = center - clamp(center, sMin, sMax);
+      visible = dot(delta, delta) <= radius * radius;
+    }
+
+    if (visible) {
+      uint slot = atomicAdd(sCount, 1u);
+      if (slot < stride - 1u) {
+        uClusterLights[cluster * stride + 1u + slot] = i;
+      }
+    }
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  if (gl_LocalInvocationIndex == 0) {
+    uClusterLights[cluster * stride] = min(sCount, stride - 1u);
+  }
+}
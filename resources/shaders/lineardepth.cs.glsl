@@ -0,0 +1,40 @@
+#version 430
+
+// One invocation per 2x2 block of pixels
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D uDepthbuffer;
+uniform vec2 uDepthRange;
+
+layout(r32f, binding = 0) writeonly uniform image2D uLinearDepth;
+
+// First level of the pyramid: the nearest and farthest depth of the block
+layout(rg32f, binding = 1) writeonly uniform image2D uPyramid;
+
+float linearDepth(float depth) {
+  float zNear = uDepthRange.x;
+  float zFar = uDepthRange.y;
+  return 2.0 * zNear * zFar / (zFar + zNear - (2.0 * depth - 1.0) * (zFar - zNear));
+}
+
+void main() {
+  ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 size = textureSize(uDepthbuffer, 0);
+  if (any(greaterThanEqual(block * 2, size))) {
+    return;
+  }
+
+  vec2 range = vec2(1e30, -1e30);
+  for (int i = 0; i < 4; i++) {
+    ivec2 p = block * 2 + ivec2(i & 1, i >> 1);
+    if (any(greaterThanEqual(p, size))) {
+      continue;
+    }
+
+    float depth = linearDepth(texelFetch(uDepthbuffer, p, 0).r);
+    imageStore(uLinearDepth, p, vec4(depth));
+    range = vec2(min(range.x, depth), max(range.y, depth));
+  }
+
+  imageStore(uPyramid, block, vec4(range, 0.0, 0.0));
+}
@@ -1,5 +1,10 @@
 #version 430
 
+// Permutation switches, defined per material by Shader::select
+#ifndef HAVE_BUMP
+#define HAVE_BUMP 0
+#endif
+
 in vec3 fPosition;
 in vec2 fTexCoord;
 in vec3 fNormal; //Already normalized
@@ -10,9 +15,7 @@ out vec4 FragNormal;
 out float FragDepth;
 
 uniform sampler2D uTexture;
-uniform int uHaveTexture;
 uniform sampler2D uBump;
-uniform int uHaveBump;
 
 uniform vec3 uAmbientLight;
 
@@ -24,26 +27,28 @@ struct LightSource {
   float specularIndex;
   float aperture;
   float intensity;
+  float radius;
 };
 
-layout(std430, binding = 1) buffer LightBlock {
-  LightSource uLights[12];
+layout(std430, binding = 1) readonly buffer LightBlock {
+  LightSource uLights[];
 };
 
-layout(std430, binding = 2) buffer MaterialBlock {
+READONLY_BLOCK(2) MaterialBlock {
   vec3 uAmbient;
   vec3 uDiffuse;
   vec3 uSpecular;
+  int uLayer;
 };
 
 void main()
 {
   vec3 normal = fNormal;
-  if (uHaveBump > 0) {
-    normal = normalize(fNormal + texture(uBump, fTexCoord).xyz);
-  }
+#if HAVE_BUMP
+  normal = normalize(fNormal + texture(uBump, fTexCoord).xyz);
+#endif
 
   FragColor = vec4(normal, 1.0);
-  FragNormal = vec4(normal / 2 + 0.5, 1.0);
+  FragNormal = vec4(packNormal(normal), 0.0, 1.0);
   FragDepth = fDepth;
 }
@@ -0,0 +1,75 @@
+#version 430
+
+// One invocation per pixel. Turns the counts of overdraw.fs.glsl into a heat
+// map, totals them for OverdrawMap and clears them for the next frame.
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform vec2 uScreenSize;
+
+layout(rgba8, binding = 0) writeonly uniform image2D uTarget;
+layout(r32ui, binding = 3) uniform coherent uimage2D uOverdraw;
+
+layout(std430, binding = 7) buffer TotalsBlock {
+  uint uFragments;
+  uint uCovered;
+  uint uMaxFragments;
+};
+
+// Counts at and above this are drawn in the hottest colour
+const float HOTTEST = 8.0;
+
+const vec3 RAMP[5] = {
+  vec3(0.0, 0.0, 1.0),
+  vec3(0.0, 1.0, 1.0),
+  vec3(0.0, 1.0, 0.0),
+  vec3(1.0, 1.0, 0.0),
+  vec3(1.0, 0.0, 0.0),
+};
+
+shared uint sFragments;
+shared uint sCovered;
+shared uint sMax;
+
+// Black where nothing was drawn, then blue for one fragment up to red
+vec3 heat(uint count) {
+  if (count == 0u) {
+    return vec3(0.0);
+  }
+
+  float t = clamp((float(count) - 1.0) / (HOTTEST - 1.0), 0.0, 1.0) * 4.0;
+  int i = min(int(t), 3);
+  return mix(RAMP[i], RAMP[i + 1], t - float(i));
+}
+
+void main() {
+  if (gl_LocalInvocationIndex == 0) {
+    sFragments = 0u;
+    sCovered = 0u;
+    sMax = 0u;
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  // Invocations outside the screen still have to reach the barrier below
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (all(lessThan(pixel, ivec2(uScreenSize)))) {
+    uint count = imageLoad(uOverdraw, pixel).r;
+    imageStore(uOverdraw, pixel, uvec4(0u));
+    imageStore(uTarget, pixel, vec4(heat(count), 1.0));
+
+    atomicAdd(sFragments, count);
+    atomicAdd(sCovered, count > 0u ? 1u : 0u);
+    atomicMax(sMax, count);
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  // One global atomic per work group
+  if (gl_LocalInvocationIndex == 0) {
+    atomicAdd(uFragments, sFragments);
+    atomicAdd(uCovered, sCovered);
+    atomicMax(uMaxFragments, sMax);
+  }
+}
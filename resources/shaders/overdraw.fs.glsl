@@ -0,0 +1,12 @@
+#version 430
+
+// Counts the fragments that pass the depth test, the same ones
+// GL_SAMPLES_PASSED counts. Without early tests the image would also count
+// fragments that are hidden afterwards.
+layout(early_fragment_tests) in;
+
+layout(r32ui, binding = 3) uniform coherent uimage2D uOverdraw;
+
+void main() {
+  imageAtomicAdd(uOverdraw, ivec2(gl_FragCoord.xy), 1u);
+}
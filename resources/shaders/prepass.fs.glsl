@@ -0,0 +1,5 @@
+#version 430
+
+// Depth only, colour writes are masked off
+void main() {
+}
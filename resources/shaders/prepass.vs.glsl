@@ -0,0 +1,19 @@
+#version 430
+
+layout(location = 0) in vec3 vPosition;
+
+READONLY_BLOCK(0) MatrixBlock {
+  mat4 uProj;
+  mat4 uView;
+};
+
+uniform mat4 uModel;
+
+// Must match the object vertex shader bit for bit, since the shading pass
+// tests against this depth with GL_EQUAL
+invariant gl_Position;
+
+void main() {
+  vec4 vmp = uModel * vec4(vPosition, 1.0);
+  gl_Position = uProj * uView * vmp;
+}
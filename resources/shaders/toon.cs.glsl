@@ -0,0 +1,87 @@
+#version 430
+
+// One invocation per pixel. The work group shares the normals and depths of
+// its tile, so each texel is fetched once instead of up to nine times.
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2D uFramebuffer;
+uniform sampler2D uNormalbuffer;
+uniform sampler2D uDepthbuffer;
+uniform sampler2D uDepth;
+uniform vec2 uScreenSize;
+
+layout(rgba8, binding = 0) writeonly uniform image2D uTarget;
+
+// The tile plus a one pixel apron on every side
+const int TILE = 16 + 2;
+
+// Normal in xyz and linear depth in w
+shared vec4 sTile[TILE * TILE];
+
+vec4 tile(ivec2 p) {
+  return sTile[p.y * TILE + p.x];
+}
+
+void main() {
+  ivec2 size = ivec2(uScreenSize);
+  ivec2 origin = ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) - 1;
+  int count = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);
+
+  // Clamping matches the edge behaviour of the fragment shader
+  for (int i = int(gl_LocalInvocationIndex); i < TILE * TILE; i += count) {
+    ivec2 p = clamp(origin + ivec2(i % TILE, i / TILE), ivec2(0), size - 1);
+    sTile[i] = vec4(unpackNormal(texelFetch(uNormalbuffer, p, 0).rg), texelFetch(uDepth, p, 0).r);
+  }
+
+  memoryBarrierShared();
+  barrier();
+
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(pixel, size))) {
+    return;
+  }
+
+  vec3 color = texelFetch(uFramebuffer, pixel, 0).rgb;
+
+  // The background is passed through
+  if (texelFetch(uDepthbuffer, pixel, 0).r == 1.0) {
+    imageStore(uTarget, pixel, vec4(color, 1.0));
+    return;
+  }
+
+  vec3 currentColor = floor(color * 3) / 3;
+
+  ivec2 p = ivec2(gl_LocalInvocationID.xy) + 1;
+  vec4 left = tile(p - ivec2(1, 0));
+  vec4 right = tile(p + ivec2(1, 0));
+  vec4 down = tile(p - ivec2(0, 1));
+  vec4 up = tile(p + ivec2(0, 1));
+
+  // Break in normal detected? The normals are unit length, so this is about
+  // 60 degrees apart
+  if (distance(left.xyz, right.xyz) > 1.0 || distance(down.xyz, up.xyz) > 1.0) {
+    currentColor = vec3(0);
+
+    // Try to detect break in depth
+  } else {
+    float depth = tile(p).w;
+
+    float leftDeltaDepth = left.w - depth;
+    float rightDeltaDepth = depth - right.w;
+    float downDeltaDepth = down.w - depth;
+    float upDeltaDepth = depth - up.w;
+
+    // Detect a smooth gradient, then whether it is in fact an edge
+    if (leftDeltaDepth - rightDeltaDepth > 0.01 * depth) {
+      if (abs(leftDeltaDepth) > 0.001 * depth || abs(rightDeltaDepth) > 0.001 * depth) {
+        currentColor = vec3(0);
+      }
+    } else if (downDeltaDepth - upDeltaDepth > 0.01 * depth) {
+      if (abs(downDeltaDepth) > 0.001 * depth || abs(upDeltaDepth) > 0.001 * depth) {
+        currentColor = vec3(0);
+      }
+    }
+  }
+
+  imageStore(uTarget, pixel, vec4(currentColor, 1.0));
+}
@@ -8,9 +8,9 @@ uniform sampler2D uDepthbuffer;
 uniform sampler2D uDepth;
 uniform vec2 uScreenSize;
 
+// Linearised once per frame by the depth pyramid pass
 float linearDepth(vec2 coord) {
-  float depth = texture(uDepthbuffer, coord).r;
-  return 2.0 * 0.1 * 200.0 / (200.1 - (2.0 * depth - 1.0) * (199.9));
+  return texture(uDepth, coord).r;
 }
 
 void main() {
@@ -21,22 +21,29 @@ void main() {
   // Current pixel being rendered normalized from [0..1]
   vec2 currentPixel = vec2(gl_FragCoord.x / uScreenSize.x, gl_FragCoord.y / uScreenSize.y);
 
+  // The background is passed through
+  if (texture(uDepthbuffer, currentPixel).r == 1.0) {
+    FragColor = vec4(texture(uFramebuffer, currentPixel).rgb, 1.0);
+    return;
+  }
+
   vec3 currentColor = floor(texture(uFramebuffer, currentPixel).rgb * 3) / 3;
 
   // Horizontal normal gradient
   float horizontalDeltaNormal = distance(
-    texture(uNormalbuffer, vec2((gl_FragCoord.x - 1) / uScreenSize.x, currentPixel.y)).rgb,
-    texture(uNormalbuffer, vec2((gl_FragCoord.x + 1) / uScreenSize.x, currentPixel.y)).rgb
+    unpackNormal(texture(uNormalbuffer, vec2((gl_FragCoord.x - 1) / uScreenSize.x, currentPixel.y)).rg),
+    unpackNormal(texture(uNormalbuffer, vec2((gl_FragCoord.x + 1) / uScreenSize.x, currentPixel.y)).rg)
   );
 
   // Vertical normal gradient
   float verticalDeltaNormal = distance(
-    texture(uNormalbuffer, vec2(currentPixel.x, (gl_FragCoord.y - 1) / uScreenSize.y)).rgb,
-    texture(uNormalbuffer, vec2(currentPixel.x, (gl_FragCoord.y + 1) / uScreenSize.y)).rgb
+    unpackNormal(texture(uNormalbuffer, vec2(currentPixel.x, (gl_FragCoord.y - 1) / uScreenSize.y)).rg),
+    unpackNormal(texture(uNormalbuffer, vec2(currentPixel.x, (gl_FragCoord.y + 1) / uScreenSize.y)).rg)
   );
 
-  // Break in normal detected?
-  if (horizontalDeltaNormal > 0.5 || verticalDeltaNormal > 0.5) {
+  // Break in normal detected? The normals are unit length, so this is about
+  // 60 degrees apart
+  if (horizontalDeltaNormal > 1.0 || verticalDeltaNormal > 1.0) {
 
     // Draw contour
     currentColor = vec3(0);
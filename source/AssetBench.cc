@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <thread>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "Assets.hh"
+
+// grieg-bench: times the CPU stages of loading the scene, without an
+// OpenGL context. Run it from the build directory, where the resources are
+// copied to.
+//
+// Every stage is run on 1, 2, 4, ... threads at once, each thread doing the
+// whole stage on its own copy of the input, and the throughput is the total
+// over all threads. The best of a few repetitions is reported.
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  constexpr int REPEATS = 3;
+
+  // Sides of the synthetic inputs
+  constexpr unsigned int SYNTHETIC_TERRAIN = 2048;
+  constexpr int SYNTHETIC_OBJ = 512;
+
+  std::vector<int> _threadCounts;
+
+  size_t fileSize(const std::string &path) {
+    return static_cast<size_t>(QFileInfo(QString::fromStdString(path)).size());
+  }
+
+  /// Runs `work(thread)` on `threads` threads at once. Returns the wall time
+  /// in seconds, best of REPEATS. `prepare(threads)`, if set, runs before
+  /// every repetition, outside of the timed part.
+  double timeParallel(int threads, const std::function<void(int)> &work,
+                      const std::function<void(int)> &prepare) {
+    double best = std::numeric_limits<double>::max();
+
+    for (int repeat = 0; repeat < REPEATS; ++repeat) {
+      if (prepare)
+        prepare(threads);
+
+      auto start = Clock::now();
+
+      std::vector<std::thread> pool;
+      pool.reserve(threads);
+      for (int i = 0; i < threads; ++i)
+        pool.emplace_back(work, i);
+      for (auto &thread : pool)
+        thread.join();
+
+      std::chrono::duration<double> elapsed = Clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+
+    return best;
+  }
+
+  void report(const std::string &stage, const std::string &input, int threads,
+              double seconds, double items, const char *unit, double bytes) {
+    auto rate = [seconds, threads](double amount) {
+      return amount * threads / std::max(seconds, 1e-9);
+    };
+
+    println("{:<16} {:<24} {:>3} {:>10.2f} ms {:>10.2f} M{}/s {:>9.1f} MB/s",
+            stage, input, threads, seconds * 1e3, rate(items) / 1e6, unit, rate(bytes) / 1e6);
+  }
+
+  /// Sweeps the thread counts over a stage that processes `items` of
+  /// `unit` and `bytes` of input per run
+  void sweep(const std::string &stage, const std::string &input, double items,
+             const char *unit, double bytes, const std::function<void(int)> &work,
+             const std::function<void(int)> &prepare = {}) {
+    for (auto threads : _threadCounts)
+      report(stage, input, threads, timeParallel(threads, work, prepare), items, unit, bytes);
+  }
+
+  /// Rolling hills well above the threshold, so that every cell is valid
+  Assets::Terrain syntheticTerrain(unsigned int side) {
+    Assets::TerrainHeader header { side, side, 0.0, 0.0, 1.0, -1 };
+    Assets::Terrain terrain(header);
+
+    for (unsigned int col = 0; col < side; ++col) {
+      for (unsigned int row = 0; row < side; ++row) {
+        terrain.grid[col * side + row] = 50.0f
+          + 20.0f * std::sin(col * 0.013f) * std::cos(row * 0.017f)
+          + 3.0f * std::sin(col * 0.21f + row * 0.19f);
+      }
+    }
+
+    return terrain;
+  }
+
+  /// Writes a grid of `side` x `side` quads with texture coordinates and
+  /// normals, in the shape the exporter writes
+  std::string writeSyntheticObj(int side) {
+    auto path = QDir::temp().filePath("grieg-bench.obj").toStdString();
+    std::ofstream file(path);
+    if (!file.is_open())
+      fatal("Couldn't write {}", path);
+
+    for (int x = 0; x <= side; ++x) {
+      for (int z = 0; z <= side; ++z) {
+        auto u = static_cast<float>(x) / side;
+        auto v = static_cast<float>(z) / side;
+        fmt::print(file, "v {:f} {:f} {:f}\n", u, std::sin(u * 7.0f) * std::cos(v * 5.0f), v);
+        fmt::print(file, "vt {:f} {:f}\n", u, v);
+        fmt::print(file, "vn 0.0 1.0 0.0\n");
+      }
+    }
+
+    auto index = [side](int x, int z) { return x * (side + 1) + z + 1; };
+    for (int x = 0; x < side; ++x) {
+      for (int z = 0; z < side; ++z) {
+        int a = index(x, z), b = index(x, z + 1), c = index(x + 1, z + 1), d = index(x + 1, z);
+        fmt::print(file, "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n", a, b, c);
+        fmt::print(file, "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n", c, d, a);
+      }
+    }
+
+    return path;
+  }
+
+  void benchTerrain(const std::string &input, const Assets::Terrain &terrain) {
+    double cells = static_cast<double>(terrain.grid.size());
+    double bytes = cells * sizeof(float);
+
+    sweep("vertices", input, cells, "vert", bytes, [&terrain](int) {
+      std::vector<Vec3> vertices;
+      vertices.reserve(terrain.grid.size());
+      Assets::generateVertices<false>(terrain, &vertices);
+    });
+
+    sweep("texcoords", input, cells, "vert", bytes, [&terrain](int) {
+      std::vector<Vec2> coords;
+      coords.reserve(terrain.grid.size());
+      Assets::generateTexCoords(terrain, &coords);
+    });
+
+    sweep("normals", input, cells, "vert", bytes, [&terrain](int) {
+      std::vector<Vec3> normals;
+      normals.reserve(terrain.grid.size());
+      Assets::generateNormals(terrain, &normals);
+    });
+
+    // Face generation clamps the grid in place, so every thread of every
+    // run starts from a fresh copy, made before the clock starts
+    std::vector<Assets::Terrain> copies;
+    sweep("faces", input, cells, "vert", bytes, [&copies](int thread) {
+      auto &copy = copies[thread];
+      std::vector<glm::ivec3> faces;
+      std::vector<GLuint> chunks;
+      Assets::generateFaces(copy, copy.grid.size(), &faces, &chunks);
+    }, [&copies, &terrain](int threads) {
+      copies.assign(threads, terrain);
+    });
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // Image format plugins are found through the application
+  QCoreApplication app(argc, argv);
+
+  auto hardware = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  for (int threads = 1; threads < hardware; threads *= 2)
+    _threadCounts.push_back(threads);
+  _threadCounts.push_back(hardware);
+
+  println("{:<16} {:<24} {:>3} {:>13} {:>17} {:>14}",
+          "stage", "input", "thr", "time", "items", "input");
+
+  // Terrain
+  {
+    const std::string name = "bergen_1024x918.bin";
+    auto path = format("resources/meshes/{}", name);
+    auto size = fileSize(path);
+    if (size == 0)
+      fatal("Couldn't find {}. Run from the build directory.", path);
+
+    auto terrain = Assets::readTerrainFile(path);
+    sweep("read bin", name, static_cast<double>(terrain.grid.size()), "vert",
+          static_cast<double>(size), [&path](int) {
+      Assets::readTerrainFile(path);
+    });
+
+    benchTerrain(name, terrain);
+    benchTerrain(format("synthetic {}x{}", SYNTHETIC_TERRAIN, SYNTHETIC_TERRAIN),
+                 syntheticTerrain(SYNTHETIC_TERRAIN));
+  }
+
+  // Meshes and materials
+  {
+    auto synthetic = writeSyntheticObj(SYNTHETIC_OBJ);
+    const std::pair<std::string, std::string> meshes[] = {
+      { "suzanne.obj", "resources/meshes/suzanne.obj" },
+      { "grieghallen.obj", "resources/meshes/grieghallen.obj" },
+      { format("synthetic {}x{}", SYNTHETIC_OBJ, SYNTHETIC_OBJ), synthetic },
+    };
+
+    for (const auto &mesh : meshes) {
+      auto obj = Assets::readObjFile(mesh.second);
+      auto path = mesh.second;
+      sweep("read obj", mesh.first, static_cast<double>(obj.positions.size()), "vert",
+            static_cast<double>(fileSize(path)), [&path](int) {
+        Assets::readObjFile(path);
+      });
+    }
+
+    QFile::remove(QString::fromStdString(synthetic));
+
+    const std::string mtl = "resources/meshes/grieghallen.mtl";
+    auto materials = Assets::readMtlFile(mtl);
+    sweep("read mtl", "grieghallen.mtl", static_cast<double>(materials.materials.size()), "mat",
+          static_cast<double>(fileSize(mtl)), [&mtl](int) {
+      Assets::readMtlFile(mtl);
+    });
+  }
+
+  // Texture decoding, as Texture::load does it
+  {
+    QDir textures("resources/textures");
+    for (const auto &entry : textures.entryInfoList(QDir::Files, QDir::Name)) {
+      auto path = entry.filePath().toStdString();
+      auto image = Assets::decodeImage(path);
+      if (image.isNull())
+        continue;
+
+      sweep("decode image", entry.fileName().toStdString(),
+            static_cast<double>(image.width()) * image.height(), "px",
+            static_cast<double>(entry.size()), [&path](int) {
+        Assets::decodeImage(path);
+      });
+    }
+  }
+
+  return 0;
+}
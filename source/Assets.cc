@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <QFile>
+#include <QTextStream>
+#include <glm/geometric.hpp>
+#include "Assets.hh"
+
+namespace {
+  // Side of the square of terrain cells making up a chunk
+  constexpr unsigned int TERRAIN_CHUNK_CELLS = 32;
+
+  // Returns true if token was read successfully
+  template<char Char = ' ', bool Skip = true>
+  bool nextTokenPos(const std::string &line, size_t &left, size_t &right) {
+    if (right == std::string::npos)
+      return false;
+
+    left = Skip ? line.find_first_not_of(Char, right) : (right == 0 ? right : right + 1);
+    right = line.find_first_of(Char, left);
+
+    return true;
+  }
+
+  template<char Char = ' ', bool Skip = true>
+  bool nextToken(const std::string &line, std::string &out, size_t &left, size_t &right) {
+    if (nextTokenPos<Char, Skip>(line, left, right)) {
+      out = line.substr(left, right - left);
+      return !out.empty();
+    }
+    return false;
+  }
+
+  template<char Char = ' ', bool Skip = true>
+  bool nextToken(const std::string &line, float &out, size_t &left, size_t &right) {
+    std::string tok;
+    if (nextToken<Char, Skip>(line, tok, left, right)) {
+      out = std::stod(tok);
+      return true;
+    }
+    return false;
+  }
+
+  template<char Char = ' ', bool Skip = true>
+  bool nextToken(const std::string &line, int &out, size_t &left, size_t &right) {
+    std::string tok;
+    if (nextToken<Char, Skip>(line, tok, left, right)) {
+      out = std::stoi(tok);
+      return true;
+    }
+    return false;
+  }
+}
+
+namespace Assets {
+  ObjFile readObjFile(const std::string &path) {
+    ObjFile obj;
+
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+      fatal("Couldn't open file {}", path);
+    }
+    QTextStream stream(&file);
+
+    while (!stream.atEnd()) {
+      std::string line, tmp;
+      line = stream.readLine().toStdString();
+
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      size_t left, right = 0;
+      nextToken(line, tmp, left, right);
+
+      /*
+       * <x:f>: x is a required float
+       * [w:i]: w is an optional integer
+       */
+
+      if (tmp == "mtllib") {
+        nextToken(line, obj.materialLib, left, right);
+      } else if (tmp == "usemtl") {
+        ObjFile::Material mat;
+        nextToken(line, mat.name, left, right);
+        obj.materials.push_back(mat);
+      } else if (tmp == "v") {
+        /* Vertex: v <x:f> <y:f> <z:f> [w:f] */
+        glm::vec3 vec;
+        nextToken(line, vec.x, left, right);
+        nextToken(line, vec.y, left, right);
+        nextToken(line, vec.z, left, right);
+
+        float w;
+        if (nextToken(line, w, left, right)) {
+          vec /= w;
+        }
+
+        obj.positions.emplace_back(vec);
+      } else if (tmp == "vt") {
+        /* Vertex texture coordinate: vt <s:f> <t:f> */
+        glm::vec2 vec;
+        nextToken(line, vec.s, left, right);
+        nextToken(line, vec.t, left, right);
+        vec.t = 1.0f - vec.t;
+        obj.texCoords.emplace_back(vec);
+      } else if (tmp == "vn") {
+        /* Vertex normal: vn <x:f> <y:f> <z:f> */
+        glm::vec3 vec;
+        nextToken(line, vec.x, left, right);
+        nextToken(line, vec.y, left, right);
+        nextToken(line, vec.z, left, right);
+        obj.normals.emplace_back(glm::normalize(vec));
+      } else if (tmp == "f") {
+        /* Face: Kind of complicated, read the wiki */
+        std::string subtok;
+        size_t subleft, subright;
+        glm::ivec3 v, vt, vn;
+        bool tex = false;
+        bool norm = false;
+
+        /* Read first space-separated token, x */
+        subleft = subright = 0;
+        nextToken(line, subtok, left, right);
+        nextToken<'/', false>(subtok, v.x, subleft, subright);
+        if (nextToken<'/', false>(subtok, vt.x, subleft, subright)) tex = true;
+        if (nextToken<'/', false>(subtok, vn.x, subleft, subright)) norm = true;
+
+        /* Read y */
+        subleft = subright = 0;
+        nextToken(line, subtok, left, right);
+        nextToken<'/', false>(subtok, v.y, subleft, subright);
+        nextToken<'/', false>(subtok, vt.y, subleft, subright);
+        nextToken<'/', false>(subtok, vn.y, subleft, subright);
+
+        /* Read z */
+        subleft = subright = 0;
+        nextToken(line, subtok, left, right);
+        nextToken<'/', false>(subtok, v.z, subleft, subright);
+        nextToken<'/', false>(subtok, vt.z, subleft, subright);
+        nextToken<'/', false>(subtok, vn.z, subleft, subright);
+
+        obj.trigs.push_back({ obj.materials.size() - 1, v, vt, vn });
+        obj.materials.back().count++;
+      }
+    }
+
+    file.close();
+
+    return obj;
+  }
+
+  MtlFile readMtlFile(const std::string &path) {
+    MtlFile mtl;
+
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+      fatal("Couldn't open material file {}", path);
+    }
+    QTextStream stream(&file);
+
+    MtlFile::Material *mat = nullptr;
+
+    while (!stream.atEnd()) {
+      std::string line, tmp;
+      line = stream.readLine().toStdString();
+
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      size_t left, right = 0;
+      nextToken(line, tmp, left, right);
+
+      if (tmp == "newmtl") {
+        std::string name;
+        nextToken(line, name, left, right);
+        mat = &mtl.materials[name];
+      } else if (tmp == "Ka") {
+        auto& vec = mat->ambient;
+        nextToken(line, vec.r, left, right);
+        nextToken(line, vec.g, left, right);
+        nextToken(line, vec.b, left, right);
+      } else if (tmp == "Kd") {
+        auto& vec = mat->diffuse;
+        nextToken(line, vec.r, left, right);
+        nextToken(line, vec.g, left, right);
+        nextToken(line, vec.b, left, right);
+      } else if (tmp == "Ks") {
+        auto& vec = mat->specular;
+        nextToken(line, vec.r, left, right);
+        nextToken(line, vec.g, left, right);
+        nextToken(line, vec.b, left, right);
+      } else if (tmp == "map_Kd") {
+        std::string str;
+        nextToken(line, str, left, right);
+        mat->textureName = str;
+      }
+    }
+
+    return mtl;
+  }
+
+  /// Reads a .bin file and loads all its contents into memory
+  Terrain readTerrainFile(const std::string &path) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QFile::ReadOnly)) {
+      fatal("Couldn't open file {}", path);
+    }
+
+    TerrainHeader header;
+
+    // Read the header
+    file.read(reinterpret_cast<char*>(&header), sizeof(TerrainHeader));
+    Terrain terrain(header);
+
+    // Read the grid points
+    file.read(
+      reinterpret_cast<char*>(terrain.grid.data()),
+      terrain.grid.size() * sizeof(float)
+    );
+
+    file.close();
+
+    return terrain;
+  }
+
+  /// Generates OpenGL-compatible vertices for the .bin file
+  /// The .obj can be normalized between [-1..1], if requested
+  template <bool Normalize>
+  void generateVertices(const Terrain &terrain, std::vector<Vec3> * vertices) {
+
+    // Prepare global coordinates (use memory in lieu of recomputing
+    // the multiplication for every vertex)
+    double currentX = Normalize ? -1.0 : terrain.header.xStart;
+    double currentZ = Normalize ? -1.0 : terrain.header.zStart;
+    unsigned int row = 0;
+    unsigned int col = 0;
+
+    // If we are normalizing, prepare the factor
+    float scale =
+      Normalize ? 2.0f / std::abs(terrain.header.cellSize *
+      (std::max(terrain.header.columns, terrain.header.rows) - 1.0f))
+      : 1.0f;
+
+    for (auto height : terrain.grid) {
+
+      // Some values are invalid. Only add if if higher than the threshold
+      if (height > terrain.header.threshold) {
+        vertices->emplace_back(currentX, height * scale, currentZ);
+      }
+
+      // Move to the next position
+      row++;
+      currentZ += terrain.header.cellSize * scale;
+
+      // And overflow if necessary
+      if (row >= terrain.header.rows) {
+        row = 0;
+        currentZ = Normalize ? -1.0 : terrain.header.zStart;
+        col++;
+        currentX += terrain.header.cellSize * scale;
+      }
+    }
+
+    // Shrink the vector. We might not need it to be so big
+    vertices->shrink_to_fit();
+  }
+
+  /// Generates the texture coordinates
+  ///
+  /// This method assumes a regular grid is being parsed and, therefore,
+  /// simply normalizes the X and Z grid coordinates into [0..1]
+  void generateTexCoords(const Terrain &terrain, std::vector<Vec2> * coords) {
+
+    // Infer a X and Z coord system for easier coord calculation
+    for (unsigned int col = 0; col < terrain.header.columns; ++col) {
+      for (unsigned int row = 0; row < terrain.header.rows; ++row) {
+
+        // Invalid vertex should be ignored
+        if (terrain.getHeight(col, row) <= terrain.header.threshold) {
+          continue;
+        }
+
+        coords->emplace_back(
+          static_cast<float>(col) / (terrain.header.columns - 1.0f),
+          (static_cast<float>(row) / (terrain.header.rows - 1.0f))
+        );
+      }
+    }
+
+    // Shrink the vector. We might not need it to be so big
+    coords->shrink_to_fit();
+  }
+
+  /// Generates the normals for each vertex
+  ///
+  /// It works by calculating the derivative of the imediate neighbors'
+  /// heights and placing them in a `Vec3`. Y will be set to `Header.CellSize`
+  /// and the vector will be normalized.
+  ///
+  /// That means that, if there is no gradient in the X or Z axes, the normal
+  /// will simply face up with a unit value.
+  ///
+  /// If a given vertex does not contain a particular neighbor, its own 
+  /// height will be used for derivation
+  void generateNormals(const Terrain &terrain, std::vector<Vec3> * normals) {
+
+    // Reserve variables for the gradient
+    float h, n, s, e, w, x, z;
+
+    // Infer a X and Z coord system for easier gradient calculation
+    for (unsigned int col = 0; col < terrain.header.columns; ++col) {
+      for (unsigned int row = 0; row < terrain.header.rows; ++row) {
+        h = terrain.getHeight(col, row);
+
+        // Invalid vertex should be ignored
+        if (h <= terrain.header.threshold) {
+          continue;
+        }
+
+        n = terrain.getHeight(col, row + 1);
+        s = terrain.getHeight(col, row - 1);
+        e = terrain.getHeight(col + 1, row);
+        w = terrain.getHeight(col - 1, row);
+
+        // We also cannot use invalid vertices for gradient calculation
+        if (n <= terrain.header.threshold) {
+          n = h;
+        }
+        if (s <= terrain.header.threshold) {
+          s = h;
+        }
+        if (e <= terrain.header.threshold) {
+          e = h;
+        }
+        if (w <= terrain.header.threshold) {
+          w = h;
+        }
+
+        // Calculate gradient
+        x = s - n;
+        z = w - e;
+
+        // Push back the normalize normal vector
+        normals->push_back(
+          glm::normalize(Vec3(x, terrain.header.cellSize, z))
+        );
+      }
+    }
+
+    // Shrink the vector. We might not need it to be so big
+    normals->shrink_to_fit();
+  }
+
+  /// Generates the indices for drawing the faces
+  ///
+  /// Since vertex, normal, and texture coordinates will all be the same,
+  /// the method returns a simple `Vec3` that represents the indices
+  ///
+  /// There are only two options given a quad represented by A B C D in
+  /// clockwise order and with A at the lower left corner: 
+  /// [A B C] [C D A]
+  /// or
+  /// [A B D] [C D B]
+  ///
+  /// The defining value will then be the smaller of A.y - C.y and B.y - D.y
+  void generateFaces(Terrain &terrain, size_t size, std::vector<glm::ivec3> * faces,
+                     std::vector<GLuint> * chunks) {
+
+    // We don't know if we will need all this, but in worst-case
+    // we will have two triangles per vertex
+    // Actually: (col - 1)*(row - 1)*2, but close enough
+    faces->reserve(size * 2);
+
+    // Since some vertices are ignored, a mapping vector must be generated
+    // to allow for proper reference pointing;
+    std::vector<size_t> indexMapper;
+    indexMapper.reserve(terrain.grid.size());
+    int currentIndex = 0;
+    for (auto & height : terrain.grid) {
+      if (height > terrain.header.threshold) {
+        indexMapper.push_back(currentIndex++);
+      } else {
+        indexMapper.push_back(0);
+
+        // This will help to see if there is an invalid vertex later
+        height = static_cast<float>(terrain.header.threshold);
+      }
+    }
+
+    // Reserve variables for the evaluated quad
+    // B - C
+    // |   |
+    // A - D
+    float a, b, c, d;
+
+    // Walk the grid in square chunks of cells, so that each chunk's faces
+    // are contiguous and spatially compact for culling
+    const auto chunk = TERRAIN_CHUNK_CELLS;
+    for (unsigned int chunkCol = 0; chunkCol < terrain.header.columns; chunkCol += chunk) {
+      for (unsigned int chunkRow = 0; chunkRow < terrain.header.rows; chunkRow += chunk) {
+        chunks->push_back(static_cast<GLuint>(faces->size()));
+
+        // Infer a X and Z coord system for easier index calculation
+        for (unsigned int col = chunkCol; col < std::min(chunkCol + chunk, terrain.header.columns); ++col) {
+          for (unsigned int row = chunkRow; row < std::min(chunkRow + chunk, terrain.header.rows); ++row) {
+
+            // We substract the thresholh because above we know that no number
+            // is less than it. This will facilitate the check later
+            a = terrain.getHeight(col, row) - terrain.header.threshold;
+            b = terrain.getHeight(col, row + 1) - terrain.header.threshold;
+            c = terrain.getHeight(col + 1, row + 1) - terrain.header.threshold;
+            d = terrain.getHeight(col + 1, row) - terrain.header.threshold;
+
+            // First, check the smaller delta Y
+            // Then verify that the diagonal is valid (larger than 0)
+            if (std::abs(a - c) < std::abs(b - d) && a * c > 0) {
+              // A-C is smaller and is valid
+              // Using [A B C] [C D A]
+
+              // Check if [A B C] is valid
+              // Since we already checked A and C, only B needs to be tested
+              if (b > 0) {
+                faces->emplace_back(
+                  indexMapper[col * terrain.header.rows + row],
+                  indexMapper[col * terrain.header.rows + row + 1],
+                  indexMapper[(col + 1) * terrain.header.rows + row + 1]
+                );
+              }
+
+              // Check if [C D A] is valid
+              // Since we already checked A and C, only D needs to be checked
+              if (d > 0) {
+                faces->emplace_back(
+                  indexMapper[(col + 1) * terrain.header.rows + row + 1],
+                  indexMapper[(col + 1) * terrain.header.rows + row],
+                  indexMapper[col * terrain.header.rows + row]
+                );
+              }
+
+            } else {
+              // B-D is smaller and possibly valid
+              // Using [A B D] [C D B]
+
+              // Check if B-D is valid
+              if (b * d > 0) {
+
+                // Check if [A B D] is valid
+                // Since we already checked B and D, only A needs to be checked
+                if (a > 0) {
+                  faces->emplace_back(
+                    indexMapper[col * terrain.header.rows + row],
+                    indexMapper[col * terrain.header.rows + row + 1],
+                    indexMapper[(col + 1) * terrain.header.rows + row]
+                  );
+                }
+
+                // Check if [C D B] is valid
+                // Since we already checked B and D, only C needs to be checked
+                if (c > 0) {
+                  faces->emplace_back(
+                    indexMapper[(col + 1) * terrain.header.rows + row + 1],
+                    indexMapper[(col + 1) * terrain.header.rows + row],
+                    indexMapper[col * terrain.header.rows + row + 1]
+                  );
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  template void generateVertices<true>(const Terrain &, std::vector<Vec3> *);
+  template void generateVertices<false>(const Terrain &, std::vector<Vec3> *);
+
+  QImage decodeImage(const std::string &path) {
+    QImage surface(QString::fromStdString(path));
+    if (surface.isNull()) {
+      return surface;
+    }
+
+    return surface.convertToFormat(QImage::Format_RGB888);
+  }
+}
@@ -0,0 +1,124 @@
+#ifndef __INF251_ASSETS__20583914
+#define __INF251_ASSETS__20583914
+
+#include <map>
+#include <string>
+#include <vector>
+#include <QImage>
+#include "infdef.hh"
+
+/// The CPU side of loading meshes and textures: parsing files and
+/// generating the terrain mesh. Nothing here touches OpenGL, so every stage
+/// can be timed without a context.
+namespace Assets {
+  struct ObjFile {
+    struct Material {
+      std::string name = "";
+      size_t count = 0;
+    };
+
+    struct Triangle {
+      size_t matIdx;
+      glm::ivec3 posIdx;
+      glm::ivec3 texIdx;
+      glm::ivec3 normIdx;
+    };
+
+    std::string materialLib{};
+    std::vector<Material> materials{ 1 };
+    std::vector<glm::vec3> positions{};
+    std::vector<glm::vec3> normals{};
+    std::vector<glm::vec2> texCoords{};
+    std::vector<Triangle> trigs{};
+  };
+
+  struct MtlFile {
+    struct Material {
+      glm::vec3 ambient{};
+      glm::vec3 diffuse{};
+      glm::vec3 specular{};
+      std::string textureName{};
+    };
+
+    std::map<std::string, Material> materials;
+  };
+
+  // A packed struct of the header for direct reading
+#pragma pack(push, 1)
+  struct TerrainHeader {
+    unsigned int columns;
+    unsigned int rows;
+    double xStart;
+    double zStart;
+    double cellSize;
+    int threshold;
+  };
+#pragma pack(pop)
+
+  // Full data holder
+  struct Terrain {
+    TerrainHeader header;
+    std::vector<float> grid;
+
+    Terrain(const TerrainHeader &newHeader) :
+      header(std::move(newHeader)),
+      grid(newHeader.columns * newHeader.rows) {}
+
+    /// Convenience method for accessing height values
+    float getHeight(int x, int z) const {
+
+      // Horizontal bound check
+      if (x < 0 || x >= header.columns) {
+        return static_cast<float>(header.threshold);
+      }
+
+      // Axial bound check
+      if (z < 0 || z >= header.rows) {
+        return static_cast<float>(header.threshold);
+      }
+
+      // The grid might have been cleared
+      int index = x * header.rows + z;
+      if (index >= grid.size()) {
+        return static_cast<float>(header.threshold);
+      }
+
+      // Fast access with no bound check, since it was already performed
+      return grid[index];
+    }
+  };
+
+  /// Parses an .obj file. Indices are kept as written, 1-based or negative.
+  ObjFile readObjFile(const std::string &path);
+
+  /// Parses an .mtl file. Textures are only named, not loaded.
+  MtlFile readMtlFile(const std::string &path);
+
+  /// Reads a .bin file and loads all its contents into memory
+  Terrain readTerrainFile(const std::string &path);
+
+  /// Generates OpenGL-compatible vertices for the .bin file
+  /// The .obj can be normalized between [-1..1], if requested
+  template <bool Normalize>
+  void generateVertices(const Terrain &terrain, std::vector<Vec3> * vertices);
+
+  /// Generates the texture coordinates, normalising the grid coordinates
+  /// into [0..1]
+  void generateTexCoords(const Terrain &terrain, std::vector<Vec2> * coords);
+
+  /// Generates the normals for each vertex from the gradient of its
+  /// neighbours' heights
+  void generateNormals(const Terrain &terrain, std::vector<Vec3> * normals);
+
+  /// Generates the indices for drawing the faces, in square chunks of
+  /// cells. The first face of each chunk is appended to `chunks`. Heights
+  /// below the threshold are clamped to it.
+  void generateFaces(Terrain &terrain, size_t size, std::vector<glm::ivec3> * faces,
+                     std::vector<GLuint> * chunks);
+
+  /// Loads an image and converts it to tightly packed RGB. Returns a null
+  /// image if the file can't be read.
+  QImage decodeImage(const std::string &path);
+}
+
+#endif //__INF251_ASSETS__20583914
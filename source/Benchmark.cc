@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <fstream>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "Benchmark.hh"
+#include "RenderStats.hh"
+
+namespace {
+  const char *MODEL_NAMES[] = {
+    "bergen_low",
+    "bergen_mid",
+    "bergen_hi",
+    "suzy_bump",
+    "suzy_water",
+  };
+
+  // In the order of Renderer::setShader
+  const char *SHADER_NAMES[] = {
+    "basic",
+    "ambient",
+    "normals",
+    "height",
+    "toon",
+    "tilt_shift",
+    "fog",
+    "overdraw",
+  };
+
+  constexpr int OVERDRAW_SHADER = 7;
+
+  QJsonObject toJson(const FrameStats::Percentiles &percentiles)
+  {
+    QJsonObject result;
+    result["p50"] = percentiles.p50;
+    result["p95"] = percentiles.p95;
+    result["p99"] = percentiles.p99;
+    result["max"] = percentiles.max;
+    return result;
+  }
+
+  double milliseconds(const QElapsedTimer &timer)
+  {
+    return timer.nsecsElapsed() / 1e6;
+  }
+}
+
+Benchmark::Benchmark(Renderer &renderer, BenchmarkOptions options) :
+  mRenderer(renderer),
+  mOptions(std::move(options))
+{
+}
+
+int Benchmark::run()
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  // Grabbing initialises the widget on its own offscreen surface and
+  // framebuffer, without a window
+  mRenderer.resize(mOptions.width, mOptions.height);
+  mRenderer.grabFramebuffer();
+  if (!mRenderer.isValid()) {
+    println(stderr, "Benchmark: couldn't create an OpenGL 4.3 context");
+    return 1;
+  }
+
+  auto startup = milliseconds(timer);
+
+  mRenderer.makeCurrent();
+  mRenderer.camera.setMode(Camera::PATH);
+
+  QJsonArray runs;
+  QJsonArray skipped;
+  for (int model = Renderer::BERGEN_LOW; model <= Renderer::SUZY_WATER; ++model) {
+    // Only the smallest terrain ships with the repository; loading a missing
+    // one is fatal, so those models are left out of the run
+    auto file = Renderer::terrainFile(static_cast<Renderer::Model>(model));
+    if (file && !QFileInfo::exists(QString::fromStdString(format("resources/meshes/{}", file)))) {
+      println(stderr, "Benchmark: skipping {}, resources/meshes/{} is missing", MODEL_NAMES[model], file);
+      skipped.append(MODEL_NAMES[model]);
+      continue;
+    }
+
+    // The renderer starts on the first model, so switching to it would be
+    // free; load it anyway, so load_ms is the same work for every model
+    timer.restart();
+    mRenderer.makeCurrent();
+    mRenderer.loadModel(static_cast<Renderer::Model>(model));
+    auto load = milliseconds(timer);
+
+    for (int shader = 0; shader <= OVERDRAW_SHADER; ++shader) {
+      mRenderer.setShader(shader);
+      mRenderer.camera.restartPath();
+
+      for (int i = 0; i < mOptions.warmup; ++i)
+        mRenderer.renderFrame();
+
+      double counters[RenderStats::COUNTERS] = {};
+      for (int i = 0; i < mOptions.frames; ++i) {
+        mRenderer.renderFrame();
+
+        for (int c = 0; c < RenderStats::COUNTERS; ++c)
+          counters[c] += RenderStats::last(static_cast<RenderStats::Counter>(c));
+      }
+
+      // The window covers only this run's measured frames
+      auto frames = std::max(mOptions.frames, 1);
+      auto &stats = mRenderer.frameStats;
+      auto cpu = stats.cpu(frames);
+      auto gpu = stats.gpu(frames);
+
+      QJsonObject passes;
+      for (int pass = 0; pass < PassTimer::PASSES; ++pass) {
+        auto p = static_cast<PassTimer::Pass>(pass);
+        passes[PassTimer::name(p)] = mRenderer.passTimes().milliseconds(p);
+      }
+
+      QJsonObject result;
+      result["model"] = MODEL_NAMES[model];
+      result["shader"] = SHADER_NAMES[shader];
+      result["load_ms"] = load;
+      result["cpu_ms"] = toJson(cpu);
+      result["gpu_ms"] = toJson(gpu);
+      result["pass_ms"] = passes;
+
+      // Averages per frame
+      QJsonObject stats;
+      for (int c = 0; c < RenderStats::COUNTERS; ++c)
+        stats[RenderStats::name(static_cast<RenderStats::Counter>(c))] = counters[c] / frames;
+      result["stats"] = stats;
+
+      if (shader == OVERDRAW_SHADER) {
+        const auto &totals = mRenderer.overdrawTotals();
+        QJsonObject overdraw;
+        overdraw["average"] = totals.average();
+        overdraw["covered_average"] = totals.coveredAverage();
+        overdraw["max"] = static_cast<int>(totals.maximum());
+        result["overdraw"] = overdraw;
+      }
+      runs.append(result);
+
+      println(stderr, "Benchmark: {} / {}: p50 {:.2f} ms CPU, {:.2f} ms GPU",
+              MODEL_NAMES[model], SHADER_NAMES[shader], cpu.p50, gpu.p50);
+
+      // Only the load of the first run belongs to the model switch
+      load = 0.0;
+    }
+  }
+
+  QJsonObject summary;
+  summary["gl_renderer"] = reinterpret_cast<const char *>(gl->glGetString(GL_RENDERER));
+  summary["gl_version"] = reinterpret_cast<const char *>(gl->glGetString(GL_VERSION));
+  summary["width"] = mOptions.width;
+  summary["height"] = mOptions.height;
+  summary["frames"] = mOptions.frames;
+  summary["warmup"] = mOptions.warmup;
+  summary["readonly_blocks"] = ReadOnlyBuffer::target == GL_UNIFORM_BUFFER ? "uniform" : "storage";
+  summary["startup_ms"] = startup;
+  summary["runs"] = runs;
+  summary["skipped_models"] = skipped;
+
+  mRenderer.doneCurrent();
+
+  // One line, so that it can be picked out of the loading messages
+  auto json = QJsonDocument(summary).toJson(QJsonDocument::Compact).toStdString();
+  println("{}", json);
+
+  if (!mOptions.output.empty()) {
+    std::ofstream file(mOptions.output);
+    if (!file.is_open()) {
+      println(stderr, "Benchmark: couldn't write {}", mOptions.output);
+      return 1;
+    }
+    file << json << '\n';
+  }
+
+  return 0;
+}
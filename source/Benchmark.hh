@@ -0,0 +1,37 @@
+#ifndef __INF251_BENCHMARK__38150627
+#define __INF251_BENCHMARK__38150627
+
+#include <string>
+#include "Renderer.hh"
+
+struct BenchmarkOptions {
+  /// Measured frames per model and shader mode
+  int frames = 300;
+
+  /// Frames drawn before measuring, for caches and the pre-pass to settle
+  int warmup = 30;
+
+  int width = 1280;
+  int height = 720;
+
+  /// Where to write the summary as well as standard output, if set
+  std::string output;
+};
+
+/// Flies the camera path through every model and shader mode on a renderer
+/// that is never shown, and prints a JSON summary
+///
+/// The path advances a fixed step per frame, so every run draws the same
+/// frames regardless of how fast they are drawn.
+class Benchmark {
+  Renderer &mRenderer;
+  BenchmarkOptions mOptions;
+
+public:
+  Benchmark(Renderer &renderer, BenchmarkOptions options);
+
+  /// Returns the exit code for the process
+  int run();
+};
+
+#endif //__INF251_BENCHMARK__38150627
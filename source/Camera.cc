@@ -8,6 +8,9 @@ namespace {
   int _height = 1;
   bool _pathInitialized = false;
 
+  // Path time advanced per update, in spline segments
+  constexpr float PATH_STEP = 0.01f;
+
   glm::ivec2 _anchor;
 
   bool _W_down = false;
@@ -18,6 +21,9 @@ namespace {
   bool _CTRL_down = false;
 }
 
+constexpr float Camera::NEAR_PLANE;
+constexpr float Camera::FAR_PLANE;
+
 Camera::Camera(QWidget * parent) :
   QObject(parent),
   mFOV(45.0f),
@@ -42,14 +48,14 @@ Mat4 Camera::projection() {
   if (mOrtho && mMode == Camera::TRACKBALL) {
     float zoom = mFOV / 22.5f;
     float ratio = static_cast<float>(_height) / static_cast<float>(_width);
-    return glm::ortho(-zoom, zoom, -zoom * ratio, zoom * ratio, 0.1f, 200.0f);
+    return glm::ortho(-zoom, zoom, -zoom * ratio, zoom * ratio, NEAR_PLANE, FAR_PLANE);
   } else {
     return glm::perspectiveFov(
       glm::radians(mFOV),
       static_cast<float>(_width),
       static_cast<float>(_height),
-      0.1f,
-      200.0f
+      NEAR_PLANE,
+      FAR_PLANE
     );
   }
 }
@@ -58,8 +64,8 @@ Mat4 Camera::skyboxPV() {
   auto proj = glm::perspectiveFov(glm::radians(mFOV),
                                   static_cast<float>(_width),
                                   static_cast<float>(_height),
-                                  0.1f,
-                                  200.0f);
+                                  NEAR_PLANE,
+                                  FAR_PLANE);
 
   auto view = rotation();
   view[3] = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -213,6 +219,7 @@ void Camera::setMode(Mode mode) {
   }
 
   mMode = mode;
+  mPathTime = 0.0f;
   projectionDirty = true;
   viewDirty = true;
 
@@ -367,9 +374,8 @@ void Camera::update() {
       }
       break;
     case Camera::PATH:
-      static float pathIndex = 0.0f;
-      auto index = path.interp(pathIndex);
-      pathIndex += 0.01f;
+      auto index = path.interp(mPathTime);
+      mPathTime += PATH_STEP;
       moveTo(index.first);
       lookAt(index.second);
       break;
@@ -29,6 +29,11 @@ public:
     BACK
   };
 
+  // Clip planes of every projection. The depth linearisation and the
+  // cluster slices read them from here.
+  static constexpr float NEAR_PLANE = 0.1f;
+  static constexpr float FAR_PLANE = 200.0f;
+
   explicit Camera(QWidget * parent);
   ~Camera() = default;
 
@@ -57,6 +62,12 @@ public:
     return mMode;
   }
 
+  // Starts the path over. The path advances a fixed step per update, so
+  // replays are identical frame for frame.
+  void restartPath() {
+    mPathTime = 0.0f;
+  }
+
   public slots:
   void mousePressed(QMouseEvent *evt);
   void mouseReleased(QMouseEvent *evt);
@@ -81,6 +92,7 @@ private:
 
   // Mode tracking
   Mode mMode = TRACKBALL;
+  float mPathTime = 0.0f;
 
   // View tracking variables
   Vec3 mTranslation;
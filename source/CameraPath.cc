@@ -1,4 +1,5 @@
 #include "CameraPath.hh"
+#include "RenderStats.hh"
 
 namespace {
   glm::vec4 _hermite(float a, float b, float c, float d)
@@ -153,4 +154,6 @@ void CameraPath::draw() const
   gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, sizeof(GLfloat) * 3, 0);
   gl->glDrawArrays(GL_LINE_LOOP, pathStart, pathCount);
   gl->glDrawArrays(GL_LINES, dirStart, dirCount);
+  RenderStats::draw(pathCount);
+  RenderStats::draw(dirCount / 2);
 }
@@ -1,5 +1,6 @@
 #include <QImage>
 #include "Cubemap.hh"
+#include "RenderStats.hh"
 
 namespace {
   enum struct Side {
@@ -93,5 +94,7 @@ void Cubemap::draw()
   gl->glActiveTexture(0);
   gl->glBindTexture(GL_TEXTURE_CUBE_MAP, mTexture);
   gl->glDrawArrays(GL_TRIANGLES, 0, 36);
+  RenderStats::add(RenderStats::TEXTURE_BINDS);
+  RenderStats::draw(12);
   gl->glDepthMask(GL_TRUE);
 }
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cmath>
+#include "DepthOfField.hh"
+#include "RenderStats.hh"
+
+namespace {
+  // Must match RADIUS and the work group size in dofblur.cs.glsl
+  constexpr int RADIUS = 2;
+  constexpr int GROUP_SIZE = 64;
+}
+
+constexpr int DepthOfField::LEVELS;
+constexpr float DepthOfField::FOCUS;
+constexpr float DepthOfField::RANGE;
+constexpr int DepthOfField::TEXTURE_UNIT;
+
+DepthOfField::~DepthOfField()
+{
+  if (mFramebuffers[0])
+    gl->glDeleteFramebuffers(2, mFramebuffers);
+
+  if (mTextures[0])
+    gl->glDeleteTextures(2, mTextures);
+}
+
+void DepthOfField::load(Sampler2D framebuffer, Sampler2D linearDepth)
+{
+  println("Loading depth of field");
+
+  mDownsample.load("dofdown", ShaderType::postprocess);
+  mDownsample.uniform("uFramebuffer") = framebuffer;
+  mDownsample.uniform("uDepth") = linearDepth;
+
+  mBlur.load("dofblur", ShaderType::postprocess);
+  mBlur.uniform("uFocus") = glm::vec2(FOCUS, RANGE);
+
+  mBlurCompute.load("dofblur", ShaderType::compute);
+  mBlurCompute.uniform("uFocus") = glm::vec2(FOCUS, RANGE);
+
+  // The original 9x9 kernel weighed a tap i pixels out by exp(d i^2), with
+  // d going from -1 in focus to 0 at the edge of the range. Half
+  // resolution texels are two pixels apart.
+  for (int level = 0; level < LEVELS; ++level) {
+    float d = static_cast<float>(level) / (LEVELS - 1) - 1.0f;
+
+    glm::vec4 weights;
+    for (int k = 0; k <= RADIUS; ++k)
+      weights[k] = std::exp(d * (2 * k) * (2 * k));
+
+    weights /= weights.x + 2.0f * (weights.y + weights.z);
+    weights.w = 0.0f;
+    mKernel->weights[level] = weights;
+  }
+
+  mKernel.update();
+}
+
+void DepthOfField::resize(int width, int height)
+{
+  mSize = { (std::max(width, 1) + 1) / 2, (std::max(height, 1) + 1) / 2 };
+
+  GLint bound;
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+
+  // Immutable storage can't be resized, so start over
+  if (mTextures[0])
+    gl->glDeleteTextures(2, mTextures);
+  if (!mFramebuffers[0])
+    gl->glGenFramebuffers(2, mFramebuffers);
+
+  gl->glGenTextures(2, mTextures);
+
+  for (int i = 0; i < 2; ++i) {
+    gl->glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT + i);
+    gl->glBindTexture(GL_TEXTURE_2D, mTextures[i]);
+    gl->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, mSize.x, mSize.y);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    gl->glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffers[i]);
+    gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTextures[i], 0);
+    if (gl->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      fatal("Depth of field framebuffer {} is incomplete", i);
+  }
+
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, bound);
+}
+
+void DepthOfField::configure(Shader &target)
+{
+  target.uniform("uBlurred") = Sampler2D(TEXTURE_UNIT);
+  target.uniform("uFocus") = glm::vec2(FOCUS, RANGE);
+}
+
+void DepthOfField::blur()
+{
+  GLint viewport[4];
+  gl->glGetIntegerv(GL_VIEWPORT, viewport);
+
+  // The targets carry depth in alpha, which blending would eat
+  gl->glDisable(GL_BLEND);
+  gl->glDisable(GL_DEPTH_TEST);
+  gl->glViewport(0, 0, mSize.x, mSize.y);
+
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffers[0]);
+  mDownsample.use();
+  gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+  RenderStats::draw(2);
+
+  // Horizontal from the first target into the second, then vertical back
+  const glm::ivec2 directions[] = { { 1, 0 }, { 0, 1 } };
+
+  if (useCompute) {
+    mBlurCompute.bindBuffer(mKernel);
+    mBlurCompute.use();
+
+    for (int pass = 0; pass < 2; ++pass) {
+      auto direction = directions[pass];
+      auto length = pass == 0 ? mSize.x : mSize.y;
+      auto rows = pass == 0 ? mSize.y : mSize.x;
+
+      mBlurCompute.uniform("uSource") = Sampler2D(TEXTURE_UNIT + pass);
+      mBlurCompute.uniform("uDirection") = direction;
+      gl->glBindImageTexture(0, mTextures[1 - pass], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+      gl->glDispatchCompute((length + GROUP_SIZE - 1) / GROUP_SIZE, rows, 1);
+
+      // The next pass and the composite sample what was just stored
+      gl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+  } else {
+    mBlur.bindBuffer(mKernel);
+    mBlur.use();
+
+    for (int pass = 0; pass < 2; ++pass) {
+      gl->glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffers[1 - pass]);
+      mBlur.uniform("uSource") = Sampler2D(TEXTURE_UNIT + pass);
+      mBlur.uniform("uDirection") = directions[pass];
+      gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+      RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+      RenderStats::draw(2);
+    }
+  }
+
+  gl->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  gl->glEnable(GL_BLEND);
+}
@@ -0,0 +1,70 @@
+#ifndef __INF251_DEPTHOFFIELD__40931726
+#define __INF251_DEPTHOFFIELD__40931726
+
+#include "Shader.hh"
+
+/// Tilt-shift depth of field. The frame is downsampled to half resolution
+/// and blurred there with a separable kernel whose width follows the
+/// distance from the focal plane. The depth shader then composites the
+/// result over the sharp frame.
+///
+/// Both half resolution targets hold the colour in rgb and the linear depth
+/// in alpha, so that the blur and the upsample never go back to the full
+/// resolution depth buffer.
+class DepthOfField {
+  static constexpr int LEVELS = 16;
+
+  // Normalised weights for the taps 0, 1 and 2 texels from the centre, for
+  // LEVELS evenly spaced amounts of blur
+  struct KernelBlock {
+    static constexpr auto name = "KernelBlock";
+    static constexpr auto binding = 4;
+
+    glm::vec4 weights[LEVELS];
+  };
+
+  // vec4 elements, so std140 adds no padding to the array
+  static_assert(sizeof(KernelBlock) == LEVELS * 16,
+                "KernelBlock doesn't match the GLSL block");
+
+  ShaderStorage<KernelBlock, 1, ReadOnlyBuffer> mKernel;
+
+  GLuint mTextures[2] {};
+  GLuint mFramebuffers[2] {};
+  glm::ivec2 mSize {};
+
+  Shader mDownsample;
+  Shader mBlur;
+  Shader mBlurCompute;
+
+public:
+  // Distance of the focal plane, and the distance from it at which the blur
+  // is at its widest
+  static constexpr float FOCUS = 5.0f;
+  static constexpr float RANGE = 5.0f;
+
+  // The half resolution targets stay bound to these texture units. The
+  // composite reads the first one.
+  static constexpr int TEXTURE_UNIT = 15;
+
+  // Blur with the compute shader, which reuses the texels of a whole row
+  // through shared memory, instead of the fragment shader
+  bool useCompute = false;
+
+  ~DepthOfField();
+
+  /// Depth is read from the linear depth built by DepthPyramid
+  void load(Sampler2D framebuffer, Sampler2D linearDepth);
+
+  /// Reallocates the half resolution targets for the given framebuffer size
+  void resize(int width, int height);
+
+  /// Sets the uniforms needed to composite the blur on a shader
+  void configure(Shader &target);
+
+  /// Downsamples and blurs the frame. Restores the viewport, but leaves the
+  /// framebuffer binding to the caller.
+  void blur();
+};
+
+#endif //__INF251_DEPTHOFFIELD__40931726
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "DepthPyramid.hh"
+#include "Camera.hh"
+
+namespace {
+  // Must match the work group size in lineardepth.cs.glsl and
+  // depthpyramid.cs.glsl
+  constexpr int GROUP_SIZE = 8;
+
+  GLuint groups(int size)
+  {
+    return (size + GROUP_SIZE - 1) / GROUP_SIZE;
+  }
+}
+
+DepthPyramid::~DepthPyramid()
+{
+  if (mLinearDepth)
+    gl->glDeleteTextures(1, &mLinearDepth);
+
+  if (mPyramid)
+    gl->glDeleteTextures(1, &mPyramid);
+}
+
+void DepthPyramid::load(Sampler2D depthbuffer, Sampler2D linearDepth, Sampler2D pyramid)
+{
+  println("Loading depth pyramid");
+
+  mLinearDepthUnit = linearDepth;
+  mPyramidUnit = pyramid;
+
+  mLinearize.load("lineardepth", ShaderType::compute);
+  mLinearize.uniform("uDepthbuffer") = depthbuffer;
+  mLinearize.uniform("uDepthRange") = glm::vec2(Camera::NEAR_PLANE, Camera::FAR_PLANE);
+
+  mReduce.load("depthpyramid", ShaderType::compute);
+
+  gl->glGenTextures(1, &mLinearDepth);
+  gl->glActiveTexture(GL_TEXTURE0 + mLinearDepthUnit.index);
+  gl->glBindTexture(GL_TEXTURE_2D, mLinearDepth);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // Min and max don't interpolate, so levels are never blended
+  gl->glGenTextures(1, &mPyramid);
+  gl->glActiveTexture(GL_TEXTURE0 + mPyramidUnit.index);
+  gl->glBindTexture(GL_TEXTURE_2D, mPyramid);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void DepthPyramid::resize(int width, int height)
+{
+  mSize = { std::max(width, 1), std::max(height, 1) };
+
+  gl->glActiveTexture(GL_TEXTURE0 + mLinearDepthUnit.index);
+  gl->glBindTexture(GL_TEXTURE_2D, mLinearDepth);
+  gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, mSize.x, mSize.y, 0, GL_RED, GL_FLOAT, nullptr);
+
+  gl->glActiveTexture(GL_TEXTURE0 + mPyramidUnit.index);
+  gl->glBindTexture(GL_TEXTURE_2D, mPyramid);
+
+  auto level = (mSize + 1) / 2;
+  mLevels = 0;
+  while (true) {
+    gl->glTexImage2D(GL_TEXTURE_2D, mLevels, GL_RG32F, level.x, level.y, 0, GL_RG, GL_FLOAT, nullptr);
+    mLevels++;
+
+    if (level.x == 1 && level.y == 1)
+      break;
+
+    level = glm::max(level / 2, glm::ivec2(1));
+  }
+
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mLevels - 1);
+}
+
+void DepthPyramid::build()
+{
+  auto half = (mSize + 1) / 2;
+
+  mLinearize.use();
+  gl->glBindImageTexture(0, mLinearDepth, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  gl->glBindImageTexture(1, mPyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+  gl->glDispatchCompute(groups(half.x), groups(half.y), 1);
+
+  mReduce.use();
+  for (int level = 1; level < mLevels; ++level) {
+    // Each level reads what the previous dispatch stored
+    gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    half = glm::max(half / 2, glm::ivec2(1));
+    gl->glBindImageTexture(1, mPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+    gl->glBindImageTexture(2, mPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+    gl->glDispatchCompute(groups(half.x), groups(half.y), 1);
+  }
+
+  // The post effects sample both textures
+  gl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
@@ -0,0 +1,49 @@
+#ifndef __INF251_DEPTHPYRAMID__86150293
+#define __INF251_DEPTHPYRAMID__86150293
+
+#include "Shader.hh"
+
+/// Linearises the scene depth once per frame for the post effects, and
+/// builds a min/max pyramid over it
+///
+/// The linear depth is an R32F texture at full resolution. The pyramid is
+/// an RG32F texture starting at half resolution, with the nearest and
+/// farthest linear depth of each texel's footprint in r and g, down to a
+/// single texel.
+class DepthPyramid {
+  GLuint mLinearDepth {};
+  GLuint mPyramid {};
+  glm::ivec2 mSize {};
+  int mLevels {};
+
+  Sampler2D mLinearDepthUnit { 0 };
+  Sampler2D mPyramidUnit { 0 };
+
+  Shader mLinearize;
+  Shader mReduce;
+
+public:
+  ~DepthPyramid();
+
+  /// The textures are kept bound to the given units
+  void load(Sampler2D depthbuffer, Sampler2D linearDepth, Sampler2D pyramid);
+
+  /// Reallocates the textures for the given framebuffer size. The texture
+  /// names stay the same.
+  void resize(int width, int height);
+
+  /// Rebuilds both textures from the depth buffer
+  void build();
+
+  GLuint linearDepth() const
+  {
+    return mLinearDepth;
+  }
+
+  GLuint pyramid() const
+  {
+    return mPyramid;
+  }
+};
+
+#endif //__INF251_DEPTHPYRAMID__86150293
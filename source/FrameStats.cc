@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <fstream>
+#include "FrameStats.hh"
+
+constexpr size_t FrameStats::CAPACITY;
+constexpr size_t FrameStats::WINDOW;
+
+void FrameStats::clear()
+{
+  std::fill(mSamples.begin(), mSamples.end(), Sample{});
+  mFirst = 0;
+  mLast = 0;
+}
+
+void FrameStats::record(uint64_t frame, float cpuMilliseconds)
+{
+  if (mFirst == mLast)
+    mFirst = frame;
+
+  auto &sample = mSamples[frame % CAPACITY];
+  sample.frame = frame;
+  sample.cpu = cpuMilliseconds;
+  sample.gpu = -1.0f;
+
+  mLast = frame + 1;
+  mFirst = std::max(mFirst, mLast > CAPACITY ? mLast - CAPACITY : 0);
+}
+
+void FrameStats::recordGpu(uint64_t frame, float gpuMilliseconds)
+{
+  auto &sample = mSamples[frame % CAPACITY];
+  if (sample.frame == frame && frame >= mFirst && frame < mLast)
+    sample.gpu = gpuMilliseconds;
+}
+
+size_t FrameStats::size() const
+{
+  return static_cast<size_t>(mLast - mFirst);
+}
+
+FrameStats::Percentiles FrameStats::percentiles(float Sample::*field, size_t window) const
+{
+  auto first = mLast - std::min<uint64_t>(window, size());
+
+  std::vector<float> values;
+  values.reserve(static_cast<size_t>(mLast - first));
+  for (auto frame = first; frame < mLast; ++frame) {
+    auto &sample = mSamples[frame % CAPACITY];
+    if (sample.frame == frame && sample.*field >= 0.0f)
+      values.push_back(sample.*field);
+  }
+
+  Percentiles result;
+  if (values.empty())
+    return result;
+
+  // Nearest rank, ceil(p * n), so every reported value is a frame that
+  // happened. Whole percents keep the rounding out of floating point.
+  std::sort(values.begin(), values.end());
+  auto rank = [&values](size_t percent) {
+    auto index = (percent * values.size() + 99) / 100;
+    return values[std::min(std::max(index, size_t(1)), values.size()) - 1];
+  };
+
+  result.p50 = rank(50);
+  result.p95 = rank(95);
+  result.p99 = rank(99);
+  result.max = values.back();
+
+  return result;
+}
+
+std::vector<FrameStats::Sample> FrameStats::samples() const
+{
+  std::vector<Sample> result;
+  result.reserve(size());
+  for (auto frame = mFirst; frame < mLast; ++frame) {
+    auto &sample = mSamples[frame % CAPACITY];
+    if (sample.frame == frame)
+      result.push_back(sample);
+  }
+
+  return result;
+}
+
+bool FrameStats::writeCsv(const std::string &path) const
+{
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    println(stderr, "Couldn't write frame times to {}", path);
+    return false;
+  }
+
+  file << "frame,cpu_ms,gpu_ms\n";
+  for (const auto &sample : samples()) {
+    file << sample.frame << ',' << sample.cpu << ',';
+    if (sample.gpu >= 0.0f)
+      file << sample.gpu;
+    file << '\n';
+  }
+
+  println("Wrote {} frame times to {}", size(), path);
+  return true;
+}
@@ -0,0 +1,70 @@
+#ifndef __INF251_FRAMESTATS__60294718
+#define __INF251_FRAMESTATS__60294718
+
+#include <string>
+#include <vector>
+#include "infdef.hh"
+
+/// Records the CPU and GPU time of recent frames, to report percentiles
+/// instead of an average that hides hitches
+///
+/// Samples are kept in a ring indexed by frame number. The GPU time of a
+/// frame is only known a couple of frames later and is filled in then;
+/// until it is, the sample's GPU time is negative.
+class FrameStats {
+public:
+  static constexpr size_t CAPACITY = 4096;
+
+  /// Frames the percentiles are computed over
+  static constexpr size_t WINDOW = 300;
+
+  struct Sample {
+    uint64_t frame = 0;
+    float cpu = -1.0f;
+    float gpu = -1.0f;
+  };
+
+  struct Percentiles {
+    float p50 = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+  };
+
+private:
+  std::vector<Sample> mSamples = std::vector<Sample>(CAPACITY);
+  uint64_t mFirst = 0;
+  uint64_t mLast = 0;
+
+  Percentiles percentiles(float Sample::*field, size_t window) const;
+
+public:
+  void clear();
+
+  /// Records the CPU time of a frame. Frames must be recorded in order.
+  void record(uint64_t frame, float cpuMilliseconds);
+
+  /// Fills in the GPU time of a frame recorded earlier, if it is still kept
+  void recordGpu(uint64_t frame, float gpuMilliseconds);
+
+  /// Number of frames kept
+  size_t size() const;
+
+  Percentiles cpu(size_t window = WINDOW) const
+  {
+    return percentiles(&Sample::cpu, window);
+  }
+
+  Percentiles gpu(size_t window = WINDOW) const
+  {
+    return percentiles(&Sample::gpu, window);
+  }
+
+  /// The kept samples, oldest first
+  std::vector<Sample> samples() const;
+
+  /// Writes the kept samples as CSV, with empty cells for missing GPU times
+  bool writeCsv(const std::string &path) const;
+};
+
+#endif //__INF251_FRAMESTATS__60294718
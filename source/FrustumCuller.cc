@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cmath>
+#include "FrustumCuller.hh"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GRIEG_CULL_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+  struct Planes {
+    // The six frustum planes, one component per array
+    float a[6];
+    float b[6];
+    float c[6];
+    float d[6];
+
+    // View space depth of a point, as a plane, for the screen size test.
+    // For orthographic projections this is the constant 1.
+    glm::vec4 depth;
+
+    // Pixels per world unit at a depth of 1
+    float scale;
+  };
+
+  // Gribb and Hartmann: each plane is the sum or difference of the last
+  // row of the clip matrix and one of the other rows
+  Planes extractPlanes(const glm::mat4 &view, const glm::mat4 &proj, int height)
+  {
+    auto clip = proj * view;
+    auto row = [&clip](int i) {
+      return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    };
+
+    const glm::vec4 planes[6] = {
+      row(3) + row(0), row(3) - row(0),
+      row(3) + row(1), row(3) - row(1),
+      row(3) + row(2), row(3) - row(2),
+    };
+
+    Planes result;
+    for (int i = 0; i < 6; ++i) {
+      result.a[i] = planes[i].x;
+      result.b[i] = planes[i].y;
+      result.c[i] = planes[i].z;
+      result.d[i] = planes[i].w;
+    }
+
+    bool perspective = proj[2][3] != 0.0f;
+    result.depth = perspective
+      ? -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2])
+      : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    result.scale = proj[1][1] * height * 0.5f;
+
+    return result;
+  }
+}
+
+constexpr float FrustumCuller::MIN_PIXELS;
+
+void FrustumCuller::clear()
+{
+  for (auto array : { &mCenterX, &mCenterY, &mCenterZ,
+                      &mExtentX, &mExtentY, &mExtentZ,
+                      &mSphereX, &mSphereY, &mSphereZ, &mRadius })
+    array->clear();
+
+  mObjects.clear();
+  mVisible.clear();
+}
+
+void FrustumCuller::add(Object &object)
+{
+  auto model = object.modelMatrix();
+
+  // The box stays axis aligned by growing to hold the transformed one
+  auto center = glm::vec3(model * glm::vec4((object.boundsMin() + object.boundsMax()) * 0.5f, 1.0f));
+  auto half = (object.boundsMax() - object.boundsMin()) * 0.5f;
+  auto linear = glm::mat3(model);
+  glm::vec3 extent;
+  for (int i = 0; i < 3; ++i)
+    extent[i] = std::abs(linear[0][i]) * half.x + std::abs(linear[1][i]) * half.y + std::abs(linear[2][i]) * half.z;
+
+  auto sphere = object.boundingSphere();
+  auto sphereCenter = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+  auto scale = std::max({ glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]) });
+
+  mCenterX.push_back(center.x);
+  mCenterY.push_back(center.y);
+  mCenterZ.push_back(center.z);
+  mExtentX.push_back(extent.x);
+  mExtentY.push_back(extent.y);
+  mExtentZ.push_back(extent.z);
+  mSphereX.push_back(sphereCenter.x);
+  mSphereY.push_back(sphereCenter.y);
+  mSphereZ.push_back(sphereCenter.z);
+  mRadius.push_back(sphere.w * scale);
+  mObjects.push_back(&object);
+}
+
+void FrustumCuller::cull(const glm::mat4 &view, const glm::mat4 &proj, int height)
+{
+  mVisible.clear();
+
+  auto count = mObjects.size();
+  if (count == 0)
+    return;
+
+  auto planes = extractPlanes(view, proj, height);
+
+  // Pad to whole groups of four. The padding is never reported visible.
+  auto padded = (count + 3) / 4 * 4;
+  for (auto array : { &mCenterX, &mCenterY, &mCenterZ,
+                      &mExtentX, &mExtentY, &mExtentZ,
+                      &mSphereX, &mSphereY, &mSphereZ, &mRadius })
+    array->resize(padded, 0.0f);
+
+  for (size_t i = 0; i < padded; i += 4) {
+    int mask = 0;
+
+#ifdef GRIEG_CULL_SSE
+    auto cx = _mm_loadu_ps(&mCenterX[i]);
+    auto cy = _mm_loadu_ps(&mCenterY[i]);
+    auto cz = _mm_loadu_ps(&mCenterZ[i]);
+    auto ex = _mm_loadu_ps(&mExtentX[i]);
+    auto ey = _mm_loadu_ps(&mExtentY[i]);
+    auto ez = _mm_loadu_ps(&mExtentZ[i]);
+    auto zero = _mm_setzero_ps();
+    auto inside = _mm_cmpeq_ps(zero, zero);
+
+    // A box is outside a plane when even its corner furthest along the
+    // normal is behind it
+    for (int p = 0; p < 6; ++p) {
+      auto a = _mm_set1_ps(planes.a[p]);
+      auto b = _mm_set1_ps(planes.b[p]);
+      auto c = _mm_set1_ps(planes.c[p]);
+
+      auto distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                                 _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(planes.d[p])));
+      auto reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(planes.a[p])), ex),
+                                         _mm_mul_ps(_mm_set1_ps(std::abs(planes.b[p])), ey)),
+                              _mm_mul_ps(_mm_set1_ps(std::abs(planes.c[p])), ez));
+
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+    }
+
+    // Radius on screen against the threshold, both scaled by the depth
+    auto sx = _mm_loadu_ps(&mSphereX[i]);
+    auto sy = _mm_loadu_ps(&mSphereY[i]);
+    auto sz = _mm_loadu_ps(&mSphereZ[i]);
+    auto depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.depth.x), sx),
+                                       _mm_mul_ps(_mm_set1_ps(planes.depth.y), sy)),
+                            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.depth.z), sz),
+                                       _mm_set1_ps(planes.depth.w)));
+    auto size = _mm_mul_ps(_mm_loadu_ps(&mRadius[i]), _mm_set1_ps(planes.scale));
+    auto least = _mm_mul_ps(_mm_max_ps(depth, zero), _mm_set1_ps(MIN_PIXELS));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(size, least));
+
+    mask = _mm_movemask_ps(inside);
+#else
+    for (size_t k = 0; k < 4; ++k) {
+      auto j = i + k;
+      bool inside = true;
+
+      for (int p = 0; p < 6 && inside; ++p) {
+        auto distance = planes.a[p] * mCenterX[j] + planes.b[p] * mCenterY[j]
+          + planes.c[p] * mCenterZ[j] + planes.d[p];
+        auto reach = std::abs(planes.a[p]) * mExtentX[j] + std::abs(planes.b[p]) * mExtentY[j]
+          + std::abs(planes.c[p]) * mExtentZ[j];
+        inside = distance + reach >= 0.0f;
+      }
+
+      auto depth = planes.depth.x * mSphereX[j] + planes.depth.y * mSphereY[j]
+        + planes.depth.z * mSphereZ[j] + planes.depth.w;
+      inside = inside && mRadius[j] * planes.scale >= std::max(depth, 0.0f) * MIN_PIXELS;
+
+      mask |= inside ? 1 << k : 0;
+    }
+#endif
+
+    for (size_t k = 0; k < 4 && i + k < count; ++k) {
+      if (mask & (1 << k))
+        mVisible.push_back(mObjects[i + k]);
+    }
+  }
+}
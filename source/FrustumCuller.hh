@@ -0,0 +1,58 @@
+#ifndef __INF251_FRUSTUMCULLER__47310862
+#define __INF251_FRUSTUMCULLER__47310862
+
+#include <vector>
+#include <glm/geometric.hpp>
+#include "Object.hh"
+
+/// Drops whole objects that are outside the view frustum, or too small on
+/// screen to matter
+///
+/// The world space bounds of the objects added each frame are kept as a
+/// structure of arrays, padded to a multiple of four, so that the plane
+/// tests run on four objects at a time with SSE where it is available.
+class FrustumCuller {
+  // World space box centres and half extents
+  std::vector<float> mCenterX;
+  std::vector<float> mCenterY;
+  std::vector<float> mCenterZ;
+  std::vector<float> mExtentX;
+  std::vector<float> mExtentY;
+  std::vector<float> mExtentZ;
+
+  // World space bounding spheres, for the screen size test
+  std::vector<float> mSphereX;
+  std::vector<float> mSphereY;
+  std::vector<float> mSphereZ;
+  std::vector<float> mRadius;
+
+  std::vector<Object *> mObjects;
+  std::vector<Object *> mVisible;
+
+public:
+  /// Objects whose bounding sphere has a smaller radius on screen are
+  /// culled
+  static constexpr float MIN_PIXELS = 1.0f;
+
+  void clear();
+
+  /// Adds an object with its current model matrix
+  void add(Object &object);
+
+  /// Tests every object added since clear() against the view of `view`
+  /// and `proj`, on a viewport `height` pixels high
+  void cull(const glm::mat4 &view, const glm::mat4 &proj, int height);
+
+  /// The objects that passed the last cull(), in the order they were added
+  const std::vector<Object *> &visible() const
+  {
+    return mVisible;
+  }
+
+  size_t culled() const
+  {
+    return mObjects.size() - mVisible.size();
+  }
+};
+
+#endif //__INF251_FRUSTUMCULLER__47310862
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "Assets.hh"
+
+// grieg-heightmap: writes a .bin terrain of any size, in the layout
+// Assets::readTerrainFile reads, filled with seeded fractal noise.
+//
+// Low areas of a second, coarser noise are set below the threshold, like
+// the sea in the Bergen data, so that loaders also see invalid cells. The
+// grid is written a column at a time, so sizes like 16384x16384 (1 GiB)
+// don't need to fit in memory.
+//
+//   grieg-heightmap --columns 2048 --rows 1836 resources/meshes/bergen_2048x1836.bin
+
+namespace {
+  // Cells per period of the lowest octave
+  constexpr float BASE_PERIOD = 256.0f;
+
+  // The hole mask is coarser than the terrain, for large connected areas
+  constexpr float MASK_PERIOD = 1024.0f;
+
+  uint32_t hash(int x, int z, uint32_t seed) {
+    auto h = static_cast<uint32_t>(x) * 0x8da6b343u
+      ^ static_cast<uint32_t>(z) * 0xd8163841u
+      ^ seed * 0xcb1ab31fu;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h;
+  }
+
+  /// Value noise in [0..1), interpolated between integer lattice points
+  float valueNoise(float x, float z, uint32_t seed) {
+    auto x0 = static_cast<int>(std::floor(x));
+    auto z0 = static_cast<int>(std::floor(z));
+    auto fx = x - x0;
+    auto fz = z - z0;
+
+    auto lattice = [seed](int x, int z) {
+      return (hash(x, z, seed) & 0xffffff) / 16777216.0f;
+    };
+
+    // Smoothstep, so that the slopes, and the normals, are continuous
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+
+    auto a = lattice(x0, z0) + (lattice(x0 + 1, z0) - lattice(x0, z0)) * fx;
+    auto b = lattice(x0, z0 + 1) + (lattice(x0 + 1, z0 + 1) - lattice(x0, z0 + 1)) * fx;
+    return a + (b - a) * fz;
+  }
+
+  /// Fractal sum of `octaves` layers of noise, each twice the frequency and
+  /// half the amplitude of the one before. Normalised to [0..1).
+  float fractalNoise(float x, float z, int octaves, uint32_t seed) {
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    for (int octave = 0; octave < octaves; ++octave) {
+      sum += valueNoise(x, z, seed + octave) * amplitude;
+      total += amplitude;
+      x *= 2.0f;
+      z *= 2.0f;
+      amplitude *= 0.5f;
+    }
+
+    return sum / total;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationName("grieg-heightmap");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Writes a synthetic .bin heightmap.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("output", "The .bin file to write.");
+
+  QCommandLineOption columnsOption("columns", "Cells along X.", "n", "4096");
+  QCommandLineOption rowsOption("rows", "Cells along Z.", "n", "4096");
+  QCommandLineOption seedOption("seed", "Noise seed.", "n", "1");
+  QCommandLineOption octavesOption("octaves", "Noise octaves.", "n", "8");
+  QCommandLineOption cellOption("cell-size", "Distance between cells.", "size", "1.0");
+  QCommandLineOption heightOption("height", "Height of the highest peaks above the threshold.", "h", "300.0");
+  QCommandLineOption thresholdOption("threshold", "Heights at or below this are invalid.", "t", "0");
+  QCommandLineOption holesOption("holes", "Rough fraction of invalid cells, 0 to 1.", "f", "0.15");
+  for (auto option : { columnsOption, rowsOption, seedOption, octavesOption,
+                       cellOption, heightOption, thresholdOption, holesOption })
+    parser.addOption(option);
+
+  parser.process(app);
+
+  auto arguments = parser.positionalArguments();
+  if (arguments.size() != 1)
+    parser.showHelp(1);
+
+  Assets::TerrainHeader header;
+  header.columns = std::max(parser.value(columnsOption).toUInt(), 2u);
+  header.rows = std::max(parser.value(rowsOption).toUInt(), 2u);
+  header.cellSize = parser.value(cellOption).toDouble();
+  header.xStart = -0.5 * header.cellSize * (header.columns - 1);
+  header.zStart = -0.5 * header.cellSize * (header.rows - 1);
+  header.threshold = parser.value(thresholdOption).toInt();
+
+  auto seed = parser.value(seedOption).toUInt();
+  auto octaves = std::max(parser.value(octavesOption).toInt(), 1);
+  auto height = parser.value(heightOption).toFloat();
+  auto holes = std::min(std::max(parser.value(holesOption).toFloat(), 0.0f), 1.0f);
+
+  auto path = arguments[0].toStdString();
+  std::ofstream file(path, std::ofstream::binary);
+  if (!file.is_open())
+    fatal("Couldn't write {}", path);
+
+  println("Writing {}x{} heightmap to {}", header.columns, header.rows, path);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // The grid is stored column by column, as Terrain::getHeight indexes it
+  std::vector<float> column(header.rows);
+  unsigned int reported = 0;
+  for (unsigned int col = 0; col < header.columns; ++col) {
+    for (unsigned int row = 0; row < header.rows; ++row) {
+      auto mask = valueNoise(col / MASK_PERIOD, row / MASK_PERIOD, seed ^ 0x9e3779b9u);
+      if (mask < holes) {
+        column[row] = header.threshold - 1.0f;
+        continue;
+      }
+
+      // Keep valid cells strictly above the threshold
+      auto noise = fractalNoise(col / BASE_PERIOD, row / BASE_PERIOD, octaves, seed);
+      column[row] = header.threshold + 0.01f + noise * height;
+    }
+
+    file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(float));
+
+    auto percent = (col + 1) * 10 / header.columns;
+    if (percent != reported) {
+      reported = percent;
+      println("  {}%", percent * 10);
+    }
+  }
+
+  if (!file)
+    fatal("Failed writing {}", path);
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "LightClusters.hh"
+#include "Camera.hh"
+
+namespace {
+  int _width = 1;
+  int _height = 1;
+}
+
+constexpr int LightClusters::TILE_SIZE;
+constexpr int LightClusters::SLICES;
+constexpr int LightClusters::MAX_LIGHTS;
+
+LightClusters::~LightClusters()
+{
+  if (mBuffer)
+    gl->glDeleteBuffers(1, &mBuffer);
+}
+
+void LightClusters::load()
+{
+  println("Loading light clusters");
+  shader.load("lightcull", ShaderType::compute);
+}
+
+void LightClusters::resize(int width, int height)
+{
+  _width = std::max(width, 1);
+  _height = std::max(height, 1);
+
+  mGrid = {
+    (_width + TILE_SIZE - 1) / TILE_SIZE,
+    (_height + TILE_SIZE - 1) / TILE_SIZE,
+    SLICES,
+  };
+
+  auto clusters = mGrid.x * mGrid.y * mGrid.z;
+
+  if (!mBuffer)
+    gl->glGenBuffers(1, &mBuffer);
+
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffer);
+  gl->glBufferData(GL_SHADER_STORAGE_BUFFER,
+                   clusters * (MAX_LIGHTS + 1) * sizeof(GLuint),
+                   nullptr,
+                   GL_DYNAMIC_COPY);
+
+  configure(shader);
+}
+
+void LightClusters::configure(Shader &target)
+{
+  target.uniform("uClusterGrid") = mGrid;
+  target.uniform("uClusterStride") = MAX_LIGHTS + 1;
+  target.uniform("uTileSize") = static_cast<float>(TILE_SIZE);
+  target.uniform("uDepthRange") = glm::vec2(Camera::NEAR_PLANE, Camera::FAR_PLANE);
+  target.uniform("uScreenSize") = glm::vec2(_width, _height);
+}
+
+void LightClusters::cull()
+{
+  shader.use();
+  gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, mBuffer);
+  gl->glDispatchCompute(mGrid.x, mGrid.y, mGrid.z);
+
+  // Fragment shaders read the lists written above
+  gl->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,38 @@
+#ifndef __INF251_LIGHTCLUSTERS__73520148
+#define __INF251_LIGHTCLUSTERS__73520148
+
+#include "Shader.hh"
+
+/// Bins lights into view-space clusters (screen tiles x depth slices) with a
+/// compute shader, so that fragments only loop over the lights that can
+/// reach them
+///
+/// Each cluster owns a fixed run of `MAX_LIGHTS + 1` indices in the cluster
+/// buffer: the light count followed by the light indices
+class LightClusters {
+  GLuint mBuffer {};
+  glm::ivec3 mGrid {};
+
+public:
+  static constexpr int TILE_SIZE = 64;
+  static constexpr int SLICES = 24;
+  static constexpr int MAX_LIGHTS = 127;
+  static constexpr auto binding = 3;
+
+  ~LightClusters();
+
+  Shader shader;
+
+  void load();
+
+  /// Reallocates the cluster buffer for the given framebuffer size
+  void resize(int width, int height);
+
+  /// Sets the uniforms needed to look up clusters on a shader
+  void configure(Shader &target);
+
+  /// Rebuilds the light lists. Lights and matrices must be up to date.
+  void cull();
+};
+
+#endif //__INF251_LIGHTCLUSTERS__73520148
@@ -1,5 +1,6 @@
 #include "MainWindow.hh"
 #include "HelpDialog.hh"
+#include "Profiler.hh"
 
 #include <memory>
 #include <QStatusBar>
@@ -7,6 +8,7 @@
 #include <QMenuBar>
 #include <QSignalMapper>
 #include <QShortcut>
+#include <QFileDialog>
 
 namespace View {
   MainWindow::MainWindow() {
@@ -68,6 +70,9 @@ namespace View {
       menu = mnbMenu->addMenu("&File");
 
       QAction *actFull = new QAction("&Fullscreen", menu);
+      QAction *actFrameTimes = new QAction("Export frame &times...", menu);
+      QAction *actRecordTrace = new QAction("&Record trace", menu);
+      QAction *actSaveTrace = new QAction("&Save trace...", menu);
       QAction *actExit = new QAction("&Exit", menu);
 
       actFull->setIcon(QIcon(":images/full.png"));
@@ -80,9 +85,18 @@ namespace View {
       actExit->setShortcut(QKeySequence(Qt::Key_Escape));
 
       connect(actFull, &QAction::triggered, this, &MainWindow::toggleFullscreen);
+      connect(actFrameTimes, &QAction::triggered, this, &MainWindow::exportFrameTimes);
+      connect(actRecordTrace, &QAction::triggered, &Profiler::setEnabled);
+      connect(actSaveTrace, &QAction::triggered, this, &MainWindow::saveTrace);
+
+      actRecordTrace->setCheckable(true);
+      actRecordTrace->setChecked(Profiler::enabled());
       connect(actExit, &QAction::triggered, this, &QMainWindow::close);
 
       menu->addAction(actFull);
+      menu->addAction(actFrameTimes);
+      menu->addAction(actRecordTrace);
+      menu->addAction(actSaveTrace);
       menu->addSeparator();
       menu->addAction(actExit);
     }
@@ -164,6 +178,12 @@ namespace View {
       QAction *actToon = new QAction("&Toon", menu);
       QAction *actTilt = new QAction("Tilt-&shift", menu);
       QAction *actFog = new QAction("Fo&g", menu);
+      QAction *actOverdraw = new QAction("O&verdraw", menu);
+      QAction *actComputeBlur = new QAction("&Compute blur", menu);
+      QAction *actComputeToon = new QAction("Compute &outlines", menu);
+      QAction *actPrepass = new QAction("Automatic &depth pre-pass", menu);
+      QAction *actOcclusion = new QAction("Occlusion c&ulling", menu);
+      QAction *actQueries = new QAction("Occlusion &queries", menu);
 
       actBasic->setCheckable(true);
       actAmbient->setCheckable(true);
@@ -172,6 +192,13 @@ namespace View {
       actToon->setCheckable(true);
       actTilt->setCheckable(true);
       actFog->setCheckable(true);
+      actOverdraw->setCheckable(true);
+      actComputeBlur->setCheckable(true);
+      actComputeToon->setCheckable(true);
+      actPrepass->setCheckable(true);
+      actPrepass->setChecked(true);
+      actOcclusion->setCheckable(true);
+      actQueries->setCheckable(true);
 
       group = new QActionGroup(menu);
       group->addAction(actBasic);
@@ -181,6 +208,7 @@ namespace View {
       group->addAction(actToon);
       group->addAction(actTilt);
       group->addAction(actFog);
+      group->addAction(actOverdraw);
       actBasic->setChecked(true);
 
       mapper = new QSignalMapper(this);
@@ -191,6 +219,7 @@ namespace View {
       mapper->setMapping(actToon, 4);
       mapper->setMapping(actTilt, 5);
       mapper->setMapping(actFog, 6);
+      mapper->setMapping(actOverdraw, 7);
 
       menu->addAction(actBasic);
       menu->addAction(actAmbient);
@@ -199,6 +228,13 @@ namespace View {
       menu->addAction(actToon);
       menu->addAction(actTilt);
       menu->addAction(actFog);
+      menu->addAction(actOverdraw);
+      menu->addSeparator();
+      menu->addAction(actComputeBlur);
+      menu->addAction(actComputeToon);
+      menu->addAction(actPrepass);
+      menu->addAction(actOcclusion);
+      menu->addAction(actQueries);
 
       connect(actBasic, SIGNAL(triggered()),
               mapper, SLOT(map()));
@@ -214,8 +250,20 @@ namespace View {
               mapper, SLOT(map()));
       connect(actFog, SIGNAL(triggered()),
               mapper, SLOT(map()));
+      connect(actOverdraw, SIGNAL(triggered()),
+              mapper, SLOT(map()));
       connect(mapper, SIGNAL(mapped(int)),
               mRenderer, SLOT(setShader(int)));
+      connect(actComputeBlur, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setComputeBlur(bool)));
+      connect(actComputeToon, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setComputeToon(bool)));
+      connect(actPrepass, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setAutoPrepass(bool)));
+      connect(actOcclusion, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setOcclusionCulling(bool)));
+      connect(actQueries, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setOcclusionQueries(bool)));
 
     }
 
@@ -329,11 +377,14 @@ namespace View {
       QAction *actSpot1 = new QAction("Light &1", menu);
       QAction *actSpot2 = new QAction("Light &2", menu);
       QAction *actRotate = new QAction("Rotate", menu);
+      QAction *actCity = new QAction("&City lights", menu);
 
       actRotate->setShortcutContext(Qt::ApplicationShortcut);
       actRotate->setShortcut(QKeySequence(Qt::Key_L));
       actRotate->setCheckable(true);
       actRotate->setChecked(true);
+      actCity->setCheckable(true);
+      actCity->setChecked(false);
 
       mapper = new QSignalMapper(this);
       mapper->setMapping(actSun, 0);
@@ -350,12 +401,15 @@ namespace View {
               mRenderer, SLOT(showPanel(int)));
       connect(actRotate, SIGNAL(triggered(bool)),
               mRenderer, SLOT(rotateLights(bool)));
+      connect(actCity, SIGNAL(triggered(bool)),
+              mRenderer, SLOT(setCityLights(bool)));
 
       menu->addAction(actSun);
       menu->addAction(actSpot1);
       menu->addAction(actSpot2);
       menu->addSeparator();
       menu->addAction(actRotate);
+      menu->addAction(actCity);
     }
 
     // Help dialog
@@ -401,6 +455,20 @@ namespace View {
     help.exec();
   }
 
+  void MainWindow::exportFrameTimes() {
+    auto path = QFileDialog::getSaveFileName(this, "Export frame times", "frametimes.csv",
+                                             "CSV files (*.csv)");
+    if (!path.isEmpty())
+      mRenderer->frameStats.writeCsv(path.toStdString());
+  }
+
+  void MainWindow::saveTrace() {
+    auto path = QFileDialog::getSaveFileName(this, "Save trace", "trace.json",
+                                             "Chrome trace files (*.json)");
+    if (!path.isEmpty())
+      Profiler::writeTrace(path.toStdString());
+  }
+
   void MainWindow::toggleFullscreen() {
     if (isFullScreen()) {
       showNormal();
@@ -43,6 +43,8 @@ namespace View {
     void resetCamera();
     void showHelp();
     void toggleFullscreen();
+    void exportFrameTimes();
+    void saveTrace();
     void setModel(int model);
 
   };
@@ -1,11 +1,17 @@
 #include <map>
 #include "Object.hh"
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
 #include <thread>
 #include <algorithm>
+#include <limits>
 
-#include <QFile>
-#include <QTextStream>
+#include <QImageReader>
+
+#include "Assets.hh"
+#include "Profiler.hh"
+#include "RenderStats.hh"
 
 #ifdef _WIN32
 #include <io.h>
@@ -16,46 +22,24 @@
 
 
 namespace {
-  // Returns true if token was read successfully
-  template<char Char = ' ', bool Skip = true>
-  bool nextTokenPos(const std::string &line, size_t &left, size_t &right) {
-    if (right == std::string::npos)
-      return false;
-
-    left = Skip ? line.find_first_not_of(Char, right) : (right == 0 ? right : right + 1);
-    right = line.find_first_of(Char, left);
-
-    return true;
-  }
-
-  template<char Char = ' ', bool Skip = true>
-  bool nextToken(const std::string &line, std::string &out, size_t &left, size_t &right) {
-    if (nextTokenPos<Char, Skip>(line, left, right)) {
-      out = line.substr(left, right - left);
-      return !out.empty();
-    }
-    return false;
-  }
-
-  template<char Char = ' ', bool Skip = true>
-  bool nextToken(const std::string &line, float &out, size_t &left, size_t &right) {
-    std::string tok;
-    if (nextToken<Char, Skip>(line, tok, left, right)) {
-      out = std::stod(tok);
-      return true;
-    }
-    return false;
-  }
-
-  template<char Char = ' ', bool Skip = true>
-  bool nextToken(const std::string &line, int &out, size_t &left, size_t &right) {
-    std::string tok;
-    if (nextToken<Char, Skip>(line, tok, left, right)) {
-      out = std::stoi(tok);
-      return true;
-    }
-    return false;
-  }
+  // Set for every object on every draw, so looked up once
+  const size_t _modelUniform = Shader::slot("uModel");
+  const size_t _boundsMinUniform = Shader::slot("uBoundsMin");
+  const size_t _boundsMaxUniform = Shader::slot("uBoundsMax");
+  const size_t _prevModelUniform = Shader::slot("uPrevModel");
+  const size_t _historyUniform = Shader::slot("uHistory");
+
+  // Triangles per chunk of an .obj mesh, whose faces aren't spatially sorted
+  constexpr GLuint OBJ_CHUNK_TRIANGLES = 4096;
+
+  // Must match the command struct in cull.cs.glsl
+  struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
 
   struct Vertex {
     glm::vec3 pos;
@@ -71,536 +55,184 @@ namespace {
   };
   static_assert(sizeof(Vertex) == sizeof(GLfloat) * 8, "sizeof Vertex is incorrect");
 
-  struct ObjFile {
-    struct Material {
-      std::string name = "";
-      size_t count = 0;
-    };
-
-    struct Triangle {
-      size_t matIdx;
-      glm::ivec3 posIdx;
-      glm::ivec3 texIdx;
-      glm::ivec3 normIdx;
-    };
-
-    std::string materialLib{};
-    std::vector<Material> materials{ 1 };
-    std::vector<glm::vec3> positions{};
-    std::vector<glm::vec3> normals{};
-    std::vector<glm::vec2> texCoords{};
-    std::vector<Triangle> trigs{};
+  struct TextureSlot {
+    std::shared_ptr<TextureArray> textureArray{};
+    int layer = -1;
   };
 
-  ObjFile readObjFile(const std::string &name) {
-    ObjFile obj;
-
-    auto path = format("resources/meshes/{}", name);
-
-    QFile file(QString::fromStdString(path));
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
-      fatal("Couldn't open file {}.obj", name);
-    }
-    QTextStream stream(&file);
-
-    println("Loading mesh: {}", name);
+  /// Packs the textures of all materials into as few texture arrays as
+  /// possible, one per bucket size, and returns each material's layer
+  std::map<std::string, TextureSlot> packMtlTextures(const Assets::MtlFile &mtl) {
+    // Bucket size -> texture names, in layer order
+    std::map<int, std::vector<std::string>> buckets;
+    std::map<std::string, std::pair<int, int>> placement;
 
-    while (!stream.atEnd()) {
-      std::string line, tmp;
-      line = stream.readLine().toStdString();
-
-      if (line.empty() || line[0] == '#')
+    for (auto &entry : mtl.materials) {
+      auto &name = entry.second.textureName;
+      if (name.empty() || placement.count(name)) {
         continue;
-
-      size_t left, right = 0;
-      nextToken(line, tmp, left, right);
-
-      /*
-       * <x:f>: x is a required float
-       * [w:i]: w is an optional integer
-       */
-
-      if (tmp == "mtllib") {
-        nextToken(line, obj.materialLib, left, right);
-      } else if (tmp == "usemtl") {
-        ObjFile::Material mat;
-        nextToken(line, mat.name, left, right);
-        obj.materials.push_back(mat);
-      } else if (tmp == "v") {
-        /* Vertex: v <x:f> <y:f> <z:f> [w:f] */
-        glm::vec3 vec;
-        nextToken(line, vec.x, left, right);
-        nextToken(line, vec.y, left, right);
-        nextToken(line, vec.z, left, right);
-
-        float w;
-        if (nextToken(line, w, left, right)) {
-          vec /= w;
-        }
-
-        obj.positions.emplace_back(vec);
-      } else if (tmp == "vt") {
-        /* Vertex texture coordinate: vt <s:f> <t:f> */
-        glm::vec2 vec;
-        nextToken(line, vec.s, left, right);
-        nextToken(line, vec.t, left, right);
-        vec.t = 1.0f - vec.t;
-        obj.texCoords.emplace_back(vec);
-      } else if (tmp == "vn") {
-        /* Vertex normal: vn <x:f> <y:f> <z:f> */
-        glm::vec3 vec;
-        nextToken(line, vec.x, left, right);
-        nextToken(line, vec.y, left, right);
-        nextToken(line, vec.z, left, right);
-        obj.normals.emplace_back(glm::normalize(vec));
-      } else if (tmp == "f") {
-        /* Face: Kind of complicated, read the wiki */
-        std::string subtok;
-        size_t subleft, subright;
-        glm::ivec3 v, vt, vn;
-        bool tex = false;
-        bool norm = false;
-
-        /* Read first space-separated token, x */
-        subleft = subright = 0;
-        nextToken(line, subtok, left, right);
-        nextToken<'/', false>(subtok, v.x, subleft, subright);
-        if (nextToken<'/', false>(subtok, vt.x, subleft, subright)) tex = true;
-        if (nextToken<'/', false>(subtok, vn.x, subleft, subright)) norm = true;
-
-        /* Read y */
-        subleft = subright = 0;
-        nextToken(line, subtok, left, right);
-        nextToken<'/', false>(subtok, v.y, subleft, subright);
-        nextToken<'/', false>(subtok, vt.y, subleft, subright);
-        nextToken<'/', false>(subtok, vn.y, subleft, subright);
-
-        /* Read z */
-        subleft = subright = 0;
-        nextToken(line, subtok, left, right);
-        nextToken<'/', false>(subtok, v.z, subleft, subright);
-        nextToken<'/', false>(subtok, vt.z, subleft, subright);
-        nextToken<'/', false>(subtok, vn.z, subleft, subright);
-
-        obj.trigs.push_back({ obj.materials.size() - 1, v, vt, vn });
-        obj.materials.back().count++;
       }
-    }
-
-    file.close();
-
-    return obj;
-  }
-
-  struct MtlFile {
-    struct Material {
-      glm::vec3 ambient{};
-      glm::vec3 diffuse{};
-      glm::vec3 specular{};
-      std::shared_ptr<Texture> texture{};
-    };
-
-    std::map<std::string, Material> materials;
-  };
-
-  MtlFile readMtlFile(const std::string &name) {
-    MtlFile mtl;
 
-    auto path = format("resources/meshes/{}", name);
+      auto path = QString::fromStdString(format("resources/textures/{}", name));
+      auto size = QImageReader(path).size();
+      if (!size.isValid()) {
+        fatal("  Could not read texture size: {}", name);
+      }
 
-    QFile file(QString::fromStdString(path));
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
-      fatal("Couldn't open material file {}", name);
+      auto bucketSize = TextureArray::bucketSize(size.width(), size.height());
+      auto &bucket = buckets[bucketSize];
+      placement[name] = std::make_pair(bucketSize, static_cast<int>(bucket.size()));
+      bucket.push_back(name);
     }
-    QTextStream stream(&file);
-
-    println("Loading materials: {}", name);
-
-    MtlFile::Material *mat = nullptr;
 
-    while (!stream.atEnd()) {
-      std::string line, tmp;
-      line = stream.readLine().toStdString();
+    std::map<int, std::shared_ptr<TextureArray>> arrays;
+    for (auto &bucket : buckets) {
+      auto array = std::make_shared<TextureArray>();
+      array->load(bucket.second, bucket.first);
+      arrays[bucket.first] = array;
+    }
 
-      if (line.empty() || line[0] == '#')
+    std::map<std::string, TextureSlot> slots;
+    for (auto &entry : mtl.materials) {
+      auto &mat = entry.second;
+      if (mat.textureName.empty()) {
         continue;
-
-      size_t left, right = 0;
-      nextToken(line, tmp, left, right);
-
-      if (tmp == "newmtl") {
-        std::string name;
-        nextToken(line, name, left, right);
-        mat = &mtl.materials[name];
-      } else if (tmp == "Ka") {
-        auto& vec = mat->ambient;
-        nextToken(line, vec.r, left, right);
-        nextToken(line, vec.g, left, right);
-        nextToken(line, vec.b, left, right);
-      } else if (tmp == "Kd") {
-        auto& vec = mat->diffuse;
-        nextToken(line, vec.r, left, right);
-        nextToken(line, vec.g, left, right);
-        nextToken(line, vec.b, left, right);
-      } else if (tmp == "Ks") {
-        auto& vec = mat->specular;
-        nextToken(line, vec.r, left, right);
-        nextToken(line, vec.g, left, right);
-        nextToken(line, vec.b, left, right);
-      } else if (tmp == "map_Kd") {
-        std::string str;
-        nextToken(line, str, left, right);
-        mat->texture = std::make_shared<Texture>();
-        mat->texture->load(str);
       }
-    }
-
-    return mtl;
-  }
 
+      auto &place = placement[mat.textureName];
+      slots[entry.first] = { arrays[place.first], place.second };
+    }
 
-  // A packed struct of the header for direct reading
-#pragma pack(push, 1)
-  struct TerrainHeader {
-    unsigned int columns;
-    unsigned int rows;
-    double xStart;
-    double zStart;
-    double cellSize;
-    int threshold;
-  };
-#pragma pack(pop)
-
-  // Full data holder
-  struct Terrain {
-    TerrainHeader header;
-    std::vector<float> grid;
-
-    Terrain(const TerrainHeader &newHeader) :
-      header(std::move(newHeader)),
-      grid(newHeader.columns * newHeader.rows) {}
+    println("  texture arrays: {}", arrays.size());
 
-    /// Convenience method for accessing height values
-    float getHeight(int x, int z) const {
+    return slots;
+  }
+}
 
-      // Horizontal bound check
-      if (x < 0 || x >= header.columns) {
-        return static_cast<float>(header.threshold);
-      }
+Object::~Object() {
+  if (mVbo)
+    gl->glDeleteBuffers(1, &mVbo);
 
-      // Axial bound check
-      if (z < 0 || z >= header.rows) {
-        return static_cast<float>(header.threshold);
-      }
+  if (mIbo)
+    gl->glDeleteBuffers(1, &mIbo);
 
-      // The grid might have been cleared
-      int index = x * header.rows + z;
-      if (index >= grid.size()) {
-        return static_cast<float>(header.threshold);
-      }
+  if (mVao)
+    gl->glDeleteVertexArrays(1, &mVao);
 
-      // Fast access with no bound check, since it was already performed
-      return grid[index];
-    }
-  };
+  if (mPositionVbo)
+    gl->glDeleteBuffers(1, &mPositionVbo);
 
-  /// Reads a .bin file and loads all its contents into memory
-  Terrain readTerrainFile(const std::string & name) {
-    auto path = format("resources/meshes/{}", name);
-    QFile file(QString::fromStdString(path));
-    if (!file.open(QFile::ReadOnly)) {
-      fatal("Couldn't open file {}.bin", name);
-    }
+  if (mPositionVao)
+    gl->glDeleteVertexArrays(1, &mPositionVao);
 
-    TerrainHeader header;
+  if (mChunkBuffer)
+    gl->glDeleteBuffers(1, &mChunkBuffer);
 
-    // Read the header
-    file.read(reinterpret_cast<char*>(&header), sizeof(TerrainHeader));
-    //header.threshold = 0;
-    println("  columns:        {}", header.columns);
-    println("  rows:           {}", header.rows);
-    println("  X start:        {}", header.xStart);
-    println("  Z start:        {}", header.zStart);
-    println("  cell size:      {}", header.cellSize);
-    println("  threshold:      {}", header.threshold);
-    Terrain terrain(header);
+  if (mCommandBuffer)
+    gl->glDeleteBuffers(1, &mCommandBuffer);
 
-    // Read the grid points
-    file.read(
-      reinterpret_cast<char*>(terrain.grid.data()),
-      terrain.grid.size() * sizeof(float)
-    );
+  if (mQueries[0])
+    gl->glDeleteQueries(2, mQueries);
+}
 
-    file.close();
+void Object::init() {
+  if (!mVbo)
+    gl->glGenBuffers(1, &mVbo);
 
-    return terrain;
-  }
+  if (!mIbo)
+    gl->glGenBuffers(1, &mIbo);
 
-  /// Generates OpenGL-compatible vertices for the .bin file
-  /// The .obj can be normalized between [-1..1], if requested
-  template <bool Normalize>
-  void generateVertices(const Terrain &terrain, std::vector<Vec3> * vertices) {
-
-    // Prepare global coordinates (use memory in lieu of recomputing
-    // the multiplication for every vertex)
-    double currentX = Normalize ? -1.0 : terrain.header.xStart;
-    double currentZ = Normalize ? -1.0 : terrain.header.zStart;
-    unsigned int row = 0;
-    unsigned int col = 0;
-
-    // If we are normalizing, prepare the factor
-    float scale =
-      Normalize ? 2.0f / std::abs(terrain.header.cellSize *
-      (std::max(terrain.header.columns, terrain.header.rows) - 1.0f))
-      : 1.0f;
-
-    for (auto height : terrain.grid) {
-
-      // Some values are invalid. Only add if if higher than the threshold
-      if (height > terrain.header.threshold) {
-        vertices->emplace_back(currentX, height * scale, currentZ);
-      }
+  if (!mVao)
+    gl->glGenVertexArrays(1, &mVao);
+}
 
-      // Move to the next position
-      row++;
-      currentZ += terrain.header.cellSize * scale;
+// The layout never changes, so unlike the interleaved stream it is set up
+// once in its own VAO
+void Object::uploadPositions(const std::vector<glm::vec3> &positions) {
+  if (!positionStream || positions.empty())
+    return;
 
-      // And overflow if necessary
-      if (row >= terrain.header.rows) {
-        row = 0;
-        currentZ = Normalize ? -1.0 : terrain.header.zStart;
-        col++;
-        currentX += terrain.header.cellSize * scale;
-      }
-    }
+  if (!mPositionVbo)
+    gl->glGenBuffers(1, &mPositionVbo);
 
-    // Shrink the vector. We might not need it to be so big
-    vertices->shrink_to_fit();
+  if (!mPositionVao)
+    gl->glGenVertexArrays(1, &mPositionVao);
 
-    println("Vertex loading done");
-  }
+  gl->glBindVertexArray(mPositionVao);
 
-  /// Generates the texture coordinates
-  ///
-  /// This method assumes a regular grid is being parsed and, therefore,
-  /// simply normalizes the X and Z grid coordinates into [0..1]
-  void generateTexCoords(const Terrain &terrain, std::vector<Vec2> * coords) {
-
-    // Infer a X and Z coord system for easier coord calculation
-    for (unsigned int col = 0; col < terrain.header.columns; ++col) {
-      for (unsigned int row = 0; row < terrain.header.rows; ++row) {
-
-        // Invalid vertex should be ignored
-        if (terrain.getHeight(col, row) <= terrain.header.threshold) {
-          continue;
-        }
-
-        coords->emplace_back(
-          static_cast<float>(col) / (terrain.header.columns - 1.0f),
-          (static_cast<float>(row) / (terrain.header.rows - 1.0f))
-        );
-      }
-    }
+  gl->glBindBuffer(GL_ARRAY_BUFFER, mPositionVbo);
+  gl->glBufferData(GL_ARRAY_BUFFER,
+                   positions.size() * sizeof(positions[0]),
+                   &positions[0],
+                   GL_STATIC_DRAW);
 
-    // Shrink the vector. We might not need it to be so big
-    coords->shrink_to_fit();
+  gl->glEnableVertexAttribArray(0);
+  gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(positions[0]), nullptr);
 
-    println("Texture coordinate loading done");
-  }
+  gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbo);
+}
 
-  /// Generates the normals for each vertex
-  ///
-  /// It works by calculating the derivative of the imediate neighbors'
-  /// heights and placing them in a `Vec3`. Y will be set to `Header.CellSize`
-  /// and the vector will be normalized.
-  ///
-  /// That means that, if there is no gradient in the X or Z axes, the normal
-  /// will simply face up with a unit value.
-  ///
-  /// If a given vertex does not contain a particular neighbor, its own 
-  /// height will be used for derivation
-  void generateNormals(const Terrain &terrain, std::vector<Vec3> * normals) {
-
-    // Reserve variables for the gradient
-    float h, n, s, e, w, x, z;
-
-    // Infer a X and Z coord system for easier gradient calculation
-    for (unsigned int col = 0; col < terrain.header.columns; ++col) {
-      for (unsigned int row = 0; row < terrain.header.rows; ++row) {
-        h = terrain.getHeight(col, row);
-
-        // Invalid vertex should be ignored
-        if (h <= terrain.header.threshold) {
-          continue;
-        }
-
-        n = terrain.getHeight(col, row + 1);
-        s = terrain.getHeight(col, row - 1);
-        e = terrain.getHeight(col + 1, row);
-        w = terrain.getHeight(col - 1, row);
-
-        // We also cannot use invalid vertices for gradient calculation
-        if (n <= terrain.header.threshold) {
-          n = h;
-        }
-        if (s <= terrain.header.threshold) {
-          s = h;
-        }
-        if (e <= terrain.header.threshold) {
-          e = h;
-        }
-        if (w <= terrain.header.threshold) {
-          w = h;
-        }
-
-        // Calculate gradient
-        x = s - n;
-        z = w - e;
-
-        // Push back the normalize normal vector
-        normals->push_back(
-          glm::normalize(Vec3(x, terrain.header.cellSize, z))
-        );
-      }
+// `firsts` holds the first triangle of each chunk, in increasing order. The
+// chunks must not straddle material groups.
+void Object::uploadChunks(const std::vector<glm::vec3> &positions,
+                          const GLuint *indices,
+                          std::vector<GLuint> firsts) {
+  std::vector<Chunk> chunks;
+  mChunkFirsts.clear();
+
+  mBoundsMin = glm::vec3(std::numeric_limits<float>::max());
+  mBoundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+
+  for (size_t i = 0; i < firsts.size(); ++i) {
+    auto first = firsts[i];
+    auto end = i + 1 < firsts.size() ? firsts[i + 1] : mTrigCount;
+    if (first >= end)
+      continue;
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(std::numeric_limits<float>::lowest());
+    for (auto index = first * 3; index < end * 3; ++index) {
+      lo = glm::min(lo, positions[indices[index]]);
+      hi = glm::max(hi, positions[indices[index]]);
     }
 
-    // Shrink the vector. We might not need it to be so big
-    normals->shrink_to_fit();
+    chunks.push_back({ glm::vec4(lo, 1.0f), glm::vec4(hi, 1.0f), { (end - first) * 3, first * 3, 0, 0 } });
+    mChunkFirsts.push_back(first);
 
-    println("Normal loading done");
+    mBoundsMin = glm::min(mBoundsMin, lo);
+    mBoundsMax = glm::max(mBoundsMax, hi);
   }
 
-  /// Generates the indices for drawing the faces
-  ///
-  /// Since vertex, normal, and texture coordinates will all be the same,
-  /// the method returns a simple `Vec3` that represents the indices
-  ///
-  /// There are only two options given a quad represented by A B C D in
-  /// clockwise order and with A at the lower left corner: 
-  /// [A B C] [C D A]
-  /// or
-  /// [A B D] [C D B]
-  ///
-  /// The defining value will then be the smaller of A.y - C.y and B.y - D.y
-  void generateFaces(Terrain &terrain, size_t size, std::vector<glm::ivec3> * faces) {
-
-    // We don't know if we will need all this, but in worst-case
-    // we will have two triangles per vertex
-    // Actually: (col - 1)*(row - 1)*2, but close enough
-    faces->reserve(size * 2);
-
-    // Since some vertices are ignored, a mapping vector must be generated
-    // to allow for proper reference pointing;
-    std::vector<size_t> indexMapper;
-    indexMapper.reserve(terrain.grid.size());
-    int currentIndex = 0;
-    for (auto & height : terrain.grid) {
-      if (height > terrain.header.threshold) {
-        indexMapper.push_back(currentIndex++);
-      } else {
-        indexMapper.push_back(0);
-
-        // This will help to see if there is an invalid vertex later
-        height = static_cast<float>(terrain.header.threshold);
-      }
-    }
+  // The sphere is centred on the box, but only as large as the vertices
+  // need it to be
+  auto center = (mBoundsMin + mBoundsMax) * 0.5f;
+  float radius = 0.0f;
+  for (const auto &position : positions)
+    radius = std::max(radius, glm::length(position - center));
+  mSphere = glm::vec4(center, radius);
 
-    // Reserve variables for the evaluated quad
-    // B - C
-    // |   |
-    // A - D
-    float a, b, c, d;
-
-    // Infer a X and Z coord system for easier index calculation
-    for (unsigned int col = 0; col < terrain.header.columns; ++col) {
-      for (unsigned int row = 0; row < terrain.header.rows; ++row) {
-
-        // We substract the thresholh because above we know that no number
-        // is less than it. This will facilitate the check later
-        a = terrain.getHeight(col, row) - terrain.header.threshold;
-        b = terrain.getHeight(col, row + 1) - terrain.header.threshold;
-        c = terrain.getHeight(col + 1, row + 1) - terrain.header.threshold;
-        d = terrain.getHeight(col + 1, row) - terrain.header.threshold;
-
-        // First, check the smaller delta Y
-        // Then verify that the diagonal is valid (larger than 0)
-        if (std::abs(a - c) < std::abs(b - d) && a * c > 0) {
-          // A-C is smaller and is valid
-          // Using [A B C] [C D A]
-
-          // Check if [A B C] is valid
-          // Since we already checked A and C, only B needs to be tested
-          if (b > 0) {
-            faces->emplace_back(
-              indexMapper[col * terrain.header.rows + row],
-              indexMapper[col * terrain.header.rows + row + 1],
-              indexMapper[(col + 1) * terrain.header.rows + row + 1]
-            );
-          }
-
-          // Check if [C D A] is valid
-          // Since we already checked A and C, only D needs to be checked
-          if (d > 0) {
-            faces->emplace_back(
-              indexMapper[(col + 1) * terrain.header.rows + row + 1],
-              indexMapper[(col + 1) * terrain.header.rows + row],
-              indexMapper[col * terrain.header.rows + row]
-            );
-          }
-
-        } else {
-          // B-D is smaller and possibly valid
-          // Using [A B D] [C D B]
-
-          // Check if B-D is valid
-          if (b * d > 0) {
-
-            // Check if [A B D] is valid
-            // Since we already checked B and D, only A needs to be checked
-            if (a > 0) {
-              faces->emplace_back(
-                indexMapper[col * terrain.header.rows + row],
-                indexMapper[col * terrain.header.rows + row + 1],
-                indexMapper[(col + 1) * terrain.header.rows + row]
-              );
-            }
-
-            // Check if [C D B] is valid
-            // Since we already checked B and D, only C needs to be checked
-            if (c > 0) {
-              faces->emplace_back(
-                indexMapper[(col + 1) * terrain.header.rows + row + 1],
-                indexMapper[(col + 1) * terrain.header.rows + row],
-                indexMapper[col * terrain.header.rows + row + 1]
-              );
-            }
-          }
-        }
-      }
-    }
-  }
-}
+  println("  chunks:         {}", chunks.size());
 
-Object::~Object() {
-  if (!mVbo)
-    gl->glDeleteBuffers(1, &mVbo);
+  if (chunks.empty())
+    return;
 
-  if (!mIbo)
-    gl->glDeleteBuffers(1, &mIbo);
+  if (!mChunkBuffer)
+    gl->glGenBuffers(1, &mChunkBuffer);
 
-  if (mVao)
-    gl->glDeleteVertexArrays(1, &mVao);
-}
-
-void Object::init() {
-  if (!mVbo)
-    gl->glGenBuffers(1, &mVbo);
+  if (!mCommandBuffer)
+    gl->glGenBuffers(1, &mCommandBuffer);
 
-  if (!mIbo)
-    gl->glGenBuffers(1, &mIbo);
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, mChunkBuffer);
+  gl->glBufferData(GL_SHADER_STORAGE_BUFFER,
+                   chunks.size() * sizeof(chunks[0]),
+                   &chunks[0],
+                   GL_STATIC_DRAW);
 
-  if (!mVao)
-    gl->glGenVertexArrays(1, &mVao);
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCommandBuffer);
+  gl->glBufferData(GL_SHADER_STORAGE_BUFFER,
+                   chunks.size() * sizeof(DrawCommand),
+                   nullptr,
+                   GL_DYNAMIC_COPY);
 }
 
 void Object::load(const std::string &name) {
@@ -618,8 +250,27 @@ void Object::load(const std::string &name) {
 }
 
 void Object::loadObjFile(const std::string &name) {
-  auto obj = readObjFile(name);
-  auto mtl = !obj.materialLib.empty() ? readMtlFile(obj.materialLib) : MtlFile{};
+  PROFILE_ZONE("Object::loadObjFile");
+
+  println("Loading mesh: {}", name);
+  Assets::ObjFile obj;
+  {
+    PROFILE_ZONE("read obj");
+    obj = Assets::readObjFile(format("resources/meshes/{}", name));
+  }
+
+  Assets::MtlFile mtl;
+  std::map<std::string, TextureSlot> slots;
+  if (!obj.materialLib.empty()) {
+    println("Loading materials: {}", obj.materialLib);
+    {
+      PROFILE_ZONE("read mtl");
+      mtl = Assets::readMtlFile(format("resources/meshes/{}", obj.materialLib));
+    }
+
+    PROFILE_ZONE("pack textures");
+    slots = packMtlTextures(mtl);
+  }
 
   /* The indices start from 1 and 0, so subtract if positive.
   * If negative, then the index refers to the vertices from the end of the list
@@ -661,9 +312,10 @@ void Object::loadObjFile(const std::string &name) {
       auto&& objMat = obj.materials[matIdx];
       auto&& mtlMat = mtl.materials[objMat.name];
       if (obj.materialLib.empty()) {
-        mMaterialGroups.push_back({ objMat.count, nullptr, nullptr, mtlMat.ambient, mtlMat.diffuse, mtlMat.specular });
+        mMaterialGroups.push_back({ objMat.count, nullptr, nullptr, mtlMat.ambient, mtlMat.diffuse, mtlMat.specular, nullptr, -1 });
       } else {
-        mMaterialGroups.push_back({ objMat.count, mtlMat.texture, nullptr, mtlMat.ambient, mtlMat.diffuse, mtlMat.specular });
+        auto&& slot = slots[objMat.name];
+        mMaterialGroups.push_back({ objMat.count, nullptr, nullptr, mtlMat.ambient, mtlMat.diffuse, mtlMat.specular, slot.textureArray, slot.layer });
       }
       matIdx = f.matIdx;
       mat = &mMaterialGroups.back();
@@ -678,6 +330,7 @@ void Object::loadObjFile(const std::string &name) {
   println("  vertices:       {}", vertices.size());
   println("  indices:        {}", indices.size());
 
+  PROFILE_ZONE("upload");
   init();
 
   gl->glBindVertexArray(mVao);
@@ -694,17 +347,48 @@ void Object::loadObjFile(const std::string &name) {
                    &indices[0],
                    GL_STATIC_DRAW);
 
-  mTrigCount = static_cast<GLuint>(indices.size());
+  mTrigCount = static_cast<GLuint>(indices.size() / 3);
+
+  std::vector<glm::vec3> positions;
+  positions.reserve(vertices.size());
+  for (const auto &vertex : vertices)
+    positions.push_back(vertex.pos);
+
+  uploadPositions(positions);
+
+  // Split each material group into runs of triangles
+  std::vector<GLuint> firsts;
+  GLuint first = 0;
+  for (const auto &group : mMaterialGroups) {
+    auto end = std::min(first + static_cast<GLuint>(group.count), mTrigCount);
+    for (auto chunk = first; chunk < end; chunk += OBJ_CHUNK_TRIANGLES)
+      firsts.push_back(chunk);
+    first = end;
+  }
+  for (auto chunk = first; chunk < mTrigCount; chunk += OBJ_CHUNK_TRIANGLES)
+    firsts.push_back(chunk);
+
+  uploadChunks(positions, &indices[0], std::move(firsts));
 
 }
 
 template <bool Normalize>
 void Object::loadBinFile(const std::string &name) {
+  PROFILE_ZONE("Object::loadBinFile");
 
   println("Loading {} as a bin file", name);
 
   // Load the actual file into memory
-  auto terrain = readTerrainFile(name);
+  auto terrain = [&name]() {
+    PROFILE_ZONE("read bin");
+    return Assets::readTerrainFile(format("resources/meshes/{}", name));
+  }();
+  println("  columns:        {}", terrain.header.columns);
+  println("  rows:           {}", terrain.header.rows);
+  println("  X start:        {}", terrain.header.xStart);
+  println("  Z start:        {}", terrain.header.zStart);
+  println("  cell size:      {}", terrain.header.cellSize);
+  println("  threshold:      {}", terrain.header.threshold);
 
   // Preemptive reservation of memory
   // Some values will be discarded and the vector might be shrunken
@@ -718,17 +402,29 @@ void Object::loadBinFile(const std::string &name) {
   // Vertices
   std::vector<Vec3> vertices;
   vertices.reserve(size);
-  threads.emplace_back(&generateVertices<Normalize>, terrain, &vertices);
+  threads.emplace_back([&terrain, &vertices]() {
+    Profiler::setThreadName("terrain vertices");
+    PROFILE_ZONE("generateVertices");
+    Assets::generateVertices<Normalize>(terrain, &vertices);
+  });
 
   // Texture coordinates
   std::vector<Vec2> coords;
   coords.reserve(size);
-  threads.emplace_back(&generateTexCoords, terrain, &coords);
+  threads.emplace_back([&terrain, &coords]() {
+    Profiler::setThreadName("terrain texcoords");
+    PROFILE_ZONE("generateTexCoords");
+    Assets::generateTexCoords(terrain, &coords);
+  });
 
   // Normals
   std::vector<Vec3> normals;
   normals.reserve(size);
-  threads.emplace_back(&generateNormals, terrain, &normals);
+  threads.emplace_back([&terrain, &normals]() {
+    Profiler::setThreadName("terrain normals");
+    PROFILE_ZONE("generateNormals");
+    Assets::generateNormals(terrain, &normals);
+  });
 
   for (int i = 0; i < threads.size(); ++i) {
     threads[i].join();
@@ -742,7 +438,12 @@ void Object::loadBinFile(const std::string &name) {
   // Fork the indices creation. This can be done in parallel with loading the
   // GL buffers
   std::vector<glm::ivec3> faces;
-  std::thread faceThread(&generateFaces, std::ref(terrain), size, &faces);
+  std::vector<GLuint> chunks;
+  std::thread faceThread([&terrain, size, &faces, &chunks]() {
+    Profiler::setThreadName("terrain faces");
+    PROFILE_ZONE("generateFaces");
+    Assets::generateFaces(terrain, size, &faces, &chunks);
+  });
 
   // Load the vertex, normal, and texture coordinate buffers
   std::vector<Vertex> buffer;
@@ -751,13 +452,14 @@ void Object::loadBinFile(const std::string &name) {
     buffer.emplace_back(vertices[i], coords[i], normals[i]);
   }
 
-  // Free unused memory
-  vertices = std::vector<Vec3>(0);
+  init();
+  uploadPositions(vertices);
+
+  // Free unused memory. The positions are still needed for the chunk bounds.
   coords = std::vector<Vec2>(0);
   normals = std::vector<Vec3>(0);
 
   // Send it to OpenGL
-  init();
   gl->glBindBuffer(GL_ARRAY_BUFFER, mVbo);
   gl->glBufferData(GL_ARRAY_BUFFER,
                    buffer.size() * sizeof(buffer[0]),
@@ -774,14 +476,19 @@ void Object::loadBinFile(const std::string &name) {
                    GL_STATIC_DRAW);
 
   mTrigCount = static_cast<GLuint>(faces.size());
+
+  static_assert(sizeof(faces[0]) == 3 * sizeof(GLuint), "faces must be packed indices");
+  uploadChunks(vertices, reinterpret_cast<const GLuint*>(&faces[0]), std::move(chunks));
 }
 
-void Object::update() {
+glm::mat4 Object::modelMatrix() const {
   glm::mat4 mat{};
   mat = glm::translate(mat, mPosition);
-  mat = mat * modelTransform;
+  return mat * modelTransform;
+}
 
-  mShader->uniform("uModel") = mat;
+void Object::update() {
+  mShader->uniform(_modelUniform) = modelMatrix();
 }
 
 void Object::bind() {
@@ -815,24 +522,41 @@ void Object::bind() {
                             reinterpret_cast<const void*>(offsetof(Vertex, norm)));
 }
 
-void Object::draw() {
+void Object::draw(ShaderFeatures features) {
+  bool conditional = beginConditional();
   update();
-  mShader->use();
   mShader->bindBuffer(matBlock);
   bind();
-  const GLuint *start = nullptr;
+  GLuint first = 0;
+
+  // Materials packed into the same texture array share a single bind
+  const TextureArray *boundArray = nullptr;
+  bool used = false;
+
   for (const auto &mat : mMaterialGroups) {
-    if (mat.texture && enableTexture) {
+    if (mat.textureArray && enableTexture) {
+      if (mat.textureArray.get() != boundArray) {
+        mat.textureArray->bind();
+        boundArray = mat.textureArray.get();
+      }
+      features.texture = 1;
+      matBlock->ambient = mat.ambient;
+      matBlock->diffuse = mat.diffuse;
+      matBlock->specular = mat.specular;
+      matBlock->layer = mat.layer;
+    } else if (mat.texture && enableTexture) {
       mat.texture->bind();
-      mShader->uniform("uHaveTexture") = 1;
+      features.texture = 1;
       matBlock->ambient = mat.ambient;
       matBlock->diffuse = mat.diffuse;
       matBlock->specular = mat.specular;
+      matBlock->layer = -1;
     } else {
       matBlock->ambient = glm::vec3(0.0f);
       matBlock->diffuse = glm::vec3(0.5f);
       matBlock->specular = glm::vec3(0.3f);
-      mShader->uniform("uHaveTexture") = 0;
+      matBlock->layer = -1;
+      features.texture = 0;
     }
 
     matBlock.update();
@@ -844,13 +568,138 @@ void Object::draw() {
 
     if (mat.bump) {
       mat.bump->bind(2);
-      mShader->uniform("uHaveBump") = 1;
+      features.bump = 1;
     } else {
-      mShader->uniform("uHaveBump") = 0;
+      features.bump = 0;
     }
 
-    gl->glDrawElements(GL_TRIANGLES, count * 3, GL_UNSIGNED_INT, start);
-    start += count * 3;
+    // Pick the permutation without the branches this material doesn't take
+    if (mShader->select(features) || !used) {
+      mShader->use();
+      used = true;
+    }
+
+    drawRange(first, count);
+    first += count;
   }
   // mShader->unbindBuffer(matBlock);
+
+  if (conditional)
+    gl->glEndConditionalRender();
+}
+
+void Object::drawDepth(Shader &shader) {
+  bool conditional = beginConditional();
+  shader.uniform(_modelUniform) = modelMatrix();
+
+  if (mPositionVao)
+    gl->glBindVertexArray(mPositionVao);
+  else
+    bind();
+
+  drawRange(0, mTrigCount);
+
+  if (conditional)
+    gl->glEndConditionalRender();
+}
+
+bool Object::beginConditional() {
+  if (!occlusionQuery || mQueryFrame + 1 != Storage::frame())
+    return false;
+
+  gl->glBeginConditionalRender(mQueries[mQueryFrame % 2], GL_QUERY_NO_WAIT);
+  return true;
+}
+
+void Object::queryVisibility(Shader &shader, const glm::vec3 &eye) {
+  auto model = modelMatrix();
+
+  // From inside, the box's faces may be clipped away by the near plane
+  auto local = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+  if (glm::all(glm::greaterThanEqual(local, mBoundsMin)) &&
+      glm::all(glm::lessThanEqual(local, mBoundsMax)))
+    return;
+
+  if (!mQueries[0])
+    gl->glGenQueries(2, mQueries);
+
+  mQueryFrame = Storage::frame();
+
+  shader.uniform(_modelUniform) = model;
+  shader.uniform(_boundsMinUniform) = mBoundsMin;
+  shader.uniform(_boundsMaxUniform) = mBoundsMax;
+  shader.use();
+
+  gl->glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, mQueries[mQueryFrame % 2]);
+  gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+  RenderStats::draw(12);
+  gl->glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+}
+
+bool Object::occluded() {
+  if (!occlusionQuery || mQueryFrame + 1 != Storage::frame())
+    return false;
+
+  auto query = mQueries[mQueryFrame % 2];
+
+  GLint available = 0;
+  gl->glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available)
+    return false;
+
+  GLuint passed = 0;
+  gl->glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+  return passed == 0;
+}
+
+// Draws the triangles [first, first + count), through this frame's culled
+// commands when there are any
+void Object::drawRange(GLuint first, GLuint count) {
+  if (mCullFrame != Storage::frame()) {
+    auto start = reinterpret_cast<const void*>(first * 3 * sizeof(GLuint));
+    gl->glDrawElements(GL_TRIANGLES, count * 3, GL_UNSIGNED_INT, start);
+    RenderStats::draw(count);
+    return;
+  }
+
+  auto begin = std::lower_bound(mChunkFirsts.begin(), mChunkFirsts.end(), first);
+  auto end = std::lower_bound(begin, mChunkFirsts.end(), first + count);
+  if (begin == end)
+    return;
+
+  auto offset = (begin - mChunkFirsts.begin()) * sizeof(DrawCommand);
+  gl->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+  gl->glMultiDrawElementsIndirect(GL_TRIANGLES,
+                                  GL_UNSIGNED_INT,
+                                  reinterpret_cast<const void*>(offset),
+                                  static_cast<GLsizei>(end - begin),
+                                  0);
+
+  // Chunks the compute pass rejected are still counted as submitted
+  RenderStats::draw(count);
+}
+
+void Object::cull(Shader &shader, bool history) {
+  if (mChunkFirsts.empty())
+    return;
+
+  auto chunks = static_cast<GLuint>(mChunkFirsts.size());
+  auto model = modelMatrix();
+
+  // The previous frame's depth only holds this object as it was drawn with
+  // the model matrix culled then. Without one, it isn't tested against it.
+  history = history && mCullFrame + 1 == Storage::frame();
+
+  shader.uniform(_modelUniform) = model;
+  shader.uniform(_prevModelUniform) = history ? mCullModel : model;
+  shader.uniform(_historyUniform) = static_cast<GLint>(history);
+  shader.uniform(_boundsMinUniform) = mBoundsMin;
+  shader.uniform(_boundsMaxUniform) = mBoundsMax;
+  shader.use();
+  gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, chunkBinding, mChunkBuffer);
+  gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commandBinding, mCommandBuffer);
+  gl->glDispatchCompute((chunks + 63) / 64, 1, 1);
+
+  mCullFrame = Storage::frame();
+  mCullModel = model;
 }
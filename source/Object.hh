@@ -2,6 +2,7 @@
 #define __INF251_OBJECT__68345092
 
 #include "Texture.hh"
+#include "TextureArray.hh"
 #include "Shader.hh"
 #include "infdef.hh"
 
@@ -13,9 +14,21 @@ class Object {
     alignas(16) glm::vec3 ambient;
     alignas(16) glm::vec3 diffuse;
     alignas(16) glm::vec3 specular;
+
+    // Layer into the bound texture array, or -1 if sampling uTexture
+    int layer;
   };
 
-  ShaderStorage<MaterialBlock> matBlock;
+  // The layer packs into the last four bytes of uSpecular, in std140 and
+  // std430 alike
+  static_assert(offsetof(MaterialBlock, diffuse) == 16 &&
+                offsetof(MaterialBlock, specular) == 32 &&
+                offsetof(MaterialBlock, layer) == 44 &&
+                sizeof(MaterialBlock) == 48,
+                "MaterialBlock doesn't match the GLSL block");
+
+  // Updated once per material group, so it must never wait on the GPU
+  ShaderStorage<MaterialBlock, 1, ReadOnlyBuffer> matBlock { StorageMode::streaming };
 
   struct MaterialGroup {
     size_t count;
@@ -24,6 +37,8 @@ class Object {
     glm::vec3 ambient;
     glm::vec3 diffuse;
     glm::vec3 specular;
+    std::shared_ptr<TextureArray> textureArray;
+    int layer;
   };
 
   // Buffers
@@ -31,6 +46,45 @@ class Object {
   GLuint mVbo = 0;
   GLuint mIbo = 0;
 
+  // Tightly packed positions sharing mIbo, for depth-only passes
+  GLuint mPositionVao = 0;
+  GLuint mPositionVbo = 0;
+
+  // A run of triangles culled as a unit, with its model space bounds
+  struct Chunk {
+    glm::vec4 min;
+    glm::vec4 max;
+
+    // Index count and first index, as the indirect draw command takes them
+    glm::uvec4 range;
+  };
+
+  // Chunk bounds for the culling shader, and the indirect draw commands it
+  // writes for them
+  GLuint mChunkBuffer = 0;
+  GLuint mCommandBuffer = 0;
+
+  // First triangle of each chunk
+  std::vector<GLuint> mChunkFirsts;
+
+  // Frame in which the commands were last written, and the model matrix
+  // they were culled with
+  uint64_t mCullFrame = 0;
+  glm::mat4 mCullModel{};
+
+  // Model space bounds of the whole mesh, as a box and as a sphere with
+  // the radius in w
+  glm::vec3 mBoundsMin{};
+  glm::vec3 mBoundsMax{};
+  glm::vec4 mSphere{};
+
+  // Bounding box visibility queries, alternating between frames. The draws
+  // of a frame are conditional on the query issued in the frame before.
+  GLuint mQueries[2] {};
+  uint64_t mQueryFrame = 0;
+
+  bool beginConditional();
+
   GLuint mTrigCount = 0;
 
   glm::vec3 mPosition{};
@@ -42,8 +96,16 @@ class Object {
   void loadObjFile(const std::string &name);
   template <bool Normalize = true> void loadBinFile(const std::string &name);
   void init();
+  void uploadPositions(const std::vector<glm::vec3> &positions);
+  void uploadChunks(const std::vector<glm::vec3> &positions,
+                    const GLuint *indices,
+                    std::vector<GLuint> firsts);
+  void drawRange(GLuint first, GLuint count);
 
 public:
+  static constexpr auto chunkBinding = 5;
+  static constexpr auto commandBinding = 6;
+
   Object() = default;
   ~Object();
 
@@ -51,6 +113,10 @@ public:
 
   bool enableTexture = true;
 
+  /// Keep a separate position-only vertex stream for drawDepth. Must be set
+  /// before load().
+  bool positionStream = true;
+
   void load(const std::string &name);
 
   void setShader(std::shared_ptr<Shader> shader) {
@@ -71,9 +137,61 @@ public:
     mPosition = position;
   }
 
+  glm::mat4 modelMatrix() const;
+
+  glm::vec3 boundsMin() const
+  {
+    return mBoundsMin;
+  }
+
+  glm::vec3 boundsMax() const
+  {
+    return mBoundsMax;
+  }
+
+  /// Centre in xyz and radius in w, in model space
+  glm::vec4 boundingSphere() const
+  {
+    return mSphere;
+  }
+
   void update();
   void bind();
-  void draw();
+
+  /// Draws every material group with the shader permutation matching it.
+  /// The light counts in `features` are passed through as they are.
+  void draw(ShaderFeatures features = {});
+
+  /// Draws all triangles in one call with `shader`, which only reads
+  /// positions. Used to lay down depth before shading. Fetches 12 bytes a
+  /// vertex instead of 32 when the position stream is kept.
+  void drawDepth(Shader &shader);
+
+  /// Writes this frame's indirect draw commands with `shader`, one per
+  /// chunk. For the rest of the frame, draws only submit the chunks it left
+  /// visible. A GL_COMMAND_BARRIER_BIT barrier must come before drawing.
+  /// `history` tells whether the previous frame's depth can be tested
+  /// against; objects not culled in that frame skip the test regardless.
+  void cull(Shader &shader, bool history);
+
+  /// Only draw when last frame's bounding box query passed. Waiting for the
+  /// result is never forced, so late results count as visible.
+  bool occlusionQuery = false;
+
+  /// Number of draw calls in draw()
+  size_t drawCount() const
+  {
+    return mMaterialGroups.size();
+  }
+
+  /// Draws the bounding box with `shader` inside a query, for the next
+  /// frame's draws to depend on. Depth and colour writes must be off.
+  /// Skipped when `eye`, in world space, is inside the box.
+  void queryVisibility(Shader &shader, const glm::vec3 &eye);
+
+  /// Whether the query this frame's draws depended on is known to have
+  /// failed. Never waits for the result.
+  bool occluded();
 };
 
 #endif //__INF251_OBJECT__68345092
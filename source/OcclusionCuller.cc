@@ -0,0 +1,32 @@
+#include "OcclusionCuller.hh"
+#include "Camera.hh"
+
+void OcclusionCuller::load(Sampler2D pyramid)
+{
+  println("Loading occlusion culling");
+
+  mShader.load("cull", ShaderType::compute);
+  mShader.uniform("uDepthPyramid") = pyramid;
+  mShader.uniform("uDepthRange") = glm::vec2(Camera::NEAR_PLANE, Camera::FAR_PLANE);
+}
+
+void OcclusionCuller::begin(const glm::mat4 &view, const glm::mat4 &proj)
+{
+  mShader.uniform("uViewProj") = proj * view;
+  mShader.uniform("uPrevView") = mPrevView;
+  mShader.uniform("uPrevProj") = mPrevProj;
+
+  mPrevView = view;
+  mPrevProj = proj;
+}
+
+void OcclusionCuller::cull(Object &object)
+{
+  object.cull(mShader, mHistory);
+}
+
+void OcclusionCuller::end()
+{
+  gl->glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  mHistory = true;
+}
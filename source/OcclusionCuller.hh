@@ -0,0 +1,47 @@
+#ifndef __INF251_OCCLUSIONCULLER__61839204
+#define __INF251_OCCLUSIONCULLER__61839204
+
+#include "Object.hh"
+
+/// Culls object chunks on the GPU against the view frustum and against the
+/// previous frame's depth pyramid (see DepthPyramid)
+///
+/// The object's box and each chunk's box are projected with the previous
+/// frame's matrices, including the object's previous model matrix, and are
+/// hidden when their nearest point lies behind the farthest depth of the
+/// pyramid texels covering them. A hidden object box hides all its chunks.
+/// The results go straight into the objects' indirect draw commands, so
+/// nothing is read back, and every object in the frustum is dispatched.
+///
+/// There is a single pass against the previous frame's pyramid. Chunks that
+/// become visible this frame (disocclusion, fast camera turns) are not
+/// re-tested against this frame's depth, so they pop in a frame late.
+class OcclusionCuller {
+  Shader mShader;
+
+  glm::mat4 mPrevView {};
+  glm::mat4 mPrevProj {};
+
+  // Whether the depth pyramid holds a frame seen through mPrevView
+  bool mHistory = false;
+
+public:
+  void load(Sampler2D pyramid);
+
+  /// Sets up the tests for a frame seen through `view` and `proj`
+  void begin(const glm::mat4 &view, const glm::mat4 &proj);
+
+  void cull(Object &object);
+
+  /// Makes the commands visible to the draws. The depth pyramid must be
+  /// rebuilt from this frame before the next begin().
+  void end();
+
+  /// Forgets the previous frame, after its depth pyramid became invalid
+  void invalidate()
+  {
+    mHistory = false;
+  }
+};
+
+#endif //__INF251_OCCLUSIONCULLER__61839204
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include "OverdrawCounter.hh"
+
+namespace {
+  // Weight of the newest result in the running average
+  constexpr float SMOOTHING = 0.1f;
+}
+
+constexpr int OverdrawCounter::QUERIES;
+
+OverdrawCounter::~OverdrawCounter()
+{
+  if (mFragmentQueries[0]) {
+    gl->glDeleteQueries(QUERIES, mFragmentQueries);
+    gl->glDeleteQueries(QUERIES, mCoverageQueries);
+  }
+}
+
+void OverdrawCounter::collect(int index)
+{
+  if (!mPending[index])
+    return;
+
+  for (auto query : { mFragmentQueries[index], mCoverageQueries[index] }) {
+    GLint available = 0;
+    gl->glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+  }
+
+  GLuint samples = 0;
+  GLuint covered = 0;
+  gl->glGetQueryObjectuiv(mFragmentQueries[index], GL_QUERY_RESULT, &samples);
+  gl->glGetQueryObjectuiv(mCoverageQueries[index], GL_QUERY_RESULT, &covered);
+  mPending[index] = false;
+
+  // Nothing on screen says nothing about overdraw
+  if (covered == 0)
+    return;
+
+  auto overdraw = static_cast<float>(samples) / covered;
+  mOverdraw = mOverdraw > 0.0f
+    ? mOverdraw + (overdraw - mOverdraw) * SMOOTHING
+    : overdraw;
+}
+
+void OverdrawCounter::begin()
+{
+  if (!mFragmentQueries[0]) {
+    gl->glGenQueries(QUERIES, mFragmentQueries);
+    gl->glGenQueries(QUERIES, mCoverageQueries);
+  }
+
+  for (int i = 0; i < QUERIES; ++i)
+    collect((mCurrent + i) % QUERIES);
+
+  mCurrent = (mCurrent + 1) % QUERIES;
+  mActive = !mPending[mCurrent];
+  if (!mActive)
+    return;
+
+  gl->glBeginQuery(GL_SAMPLES_PASSED, mFragmentQueries[mCurrent]);
+}
+
+void OverdrawCounter::end()
+{
+  if (mActive)
+    gl->glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void OverdrawCounter::beginCoverage()
+{
+  if (mActive)
+    gl->glBeginQuery(GL_SAMPLES_PASSED, mCoverageQueries[mCurrent]);
+}
+
+void OverdrawCounter::endCoverage()
+{
+  if (!mActive)
+    return;
+
+  gl->glEndQuery(GL_SAMPLES_PASSED);
+  mPending[mCurrent] = true;
+  mActive = false;
+}
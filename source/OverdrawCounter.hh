@@ -0,0 +1,49 @@
+#ifndef __INF251_OVERDRAWCOUNTER__29471830
+#define __INF251_OVERDRAWCOUNTER__29471830
+
+#include "infdef.hh"
+
+/// Measures how many fragments per covered pixel pass the depth test in a
+/// pass, with GL_SAMPLES_PASSED queries
+///
+/// A second query counts the covered pixels, around a draw the caller makes
+/// to touch each of them once. Dividing by the whole viewport instead would
+/// make scenes with a lot of sky look cheaper than they are.
+///
+/// Results are picked up a couple of frames late, once the GPU has them, so
+/// that counting never stalls the pipeline. A frame is skipped if its query
+/// objects are still in flight.
+class OverdrawCounter {
+  static constexpr int QUERIES = 3;
+
+  GLuint mFragmentQueries[QUERIES] {};
+  GLuint mCoverageQueries[QUERIES] {};
+  bool mPending[QUERIES] {};
+  int mCurrent = 0;
+  bool mActive = false;
+
+  float mOverdraw = 0.0f;
+
+  void collect(int index);
+
+public:
+  ~OverdrawCounter();
+
+  /// Starts counting the pass's fragments
+  void begin();
+
+  void end();
+
+  /// Counts the covered pixels, after end()
+  void beginCoverage();
+
+  void endCoverage();
+
+  /// Passing fragments per covered pixel, averaged over the last few results
+  float overdraw() const
+  {
+    return mOverdraw;
+  }
+};
+
+#endif //__INF251_OVERDRAWCOUNTER__29471830
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <vector>
+#include "OverdrawMap.hh"
+
+constexpr int OverdrawMap::SLOTS;
+constexpr int OverdrawMap::IMAGE_UNIT;
+
+OverdrawMap::~OverdrawMap()
+{
+  if (mTexture)
+    gl->glDeleteTextures(1, &mTexture);
+
+  for (auto &slot : mSlots) {
+    if (slot.buffer)
+      gl->glDeleteBuffers(1, &slot.buffer);
+    if (slot.fence)
+      gl->glDeleteSync(slot.fence);
+  }
+}
+
+void OverdrawMap::resize(int width, int height)
+{
+  mSize = { std::max(width, 1), std::max(height, 1) };
+
+  if (!mTexture)
+    gl->glGenTextures(1, &mTexture);
+
+  // The heat map clears what it reads, so only a new image starts at zero
+  std::vector<GLuint> zeros(mSize.x * mSize.y);
+  gl->glBindTexture(GL_TEXTURE_2D, mTexture);
+  gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, mSize.x, mSize.y, 0,
+                   GL_RED_INTEGER, GL_UNSIGNED_INT, zeros.data());
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+}
+
+void OverdrawMap::collect(Slot &slot)
+{
+  if (!slot.fence)
+    return;
+
+  auto status = gl->glClientWaitSync(slot.fence, 0, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    return;
+
+  gl->glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  Totals totals;
+  gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+  gl->glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(totals), &totals);
+
+  mAverage = static_cast<float>(totals.fragments) / std::max(slot.pixels, 1);
+  mCoveredAverage = static_cast<float>(totals.fragments) / std::max(totals.covered, 1u);
+  mMax = totals.max;
+}
+
+void OverdrawMap::begin()
+{
+  // The heat map's stores must land before the readback and before this
+  // frame's atomics
+  gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  // Everything up to here includes last frame's heat map
+  if (mResolved) {
+    mSlots[mCurrent].fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mResolved = false;
+  }
+
+  for (int i = 1; i <= SLOTS; ++i)
+    collect(mSlots[(mCurrent + i) % SLOTS]);
+
+  gl->glBindImageTexture(IMAGE_UNIT, mTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+}
+
+void OverdrawMap::resolve()
+{
+  // The scene's atomics must land before the heat map reads the counts
+  gl->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+  mCurrent = (mCurrent + 1) % SLOTS;
+  auto &slot = mSlots[mCurrent];
+
+  // Still in flight; its totals are dropped
+  if (slot.fence) {
+    gl->glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+  }
+
+  const Totals zero {};
+  if (!slot.buffer) {
+    gl->glGenBuffers(1, &slot.buffer);
+    gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+    gl->glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Totals), &zero, GL_DYNAMIC_READ);
+  } else {
+    gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+    gl->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Totals), &zero);
+  }
+
+  gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, slot.buffer);
+  slot.pixels = mSize.x * mSize.y;
+  mResolved = true;
+}
@@ -0,0 +1,80 @@
+#ifndef __INF251_OVERDRAWMAP__63094172
+#define __INF251_OVERDRAWMAP__63094172
+
+#include "infdef.hh"
+
+/// Per-pixel fragment counts for the overdraw shader mode
+///
+/// The overdraw object shader adds one to an r32ui image for every fragment
+/// that passes the depth test. GL doesn't blend into integer targets, so it
+/// counts with image atomics instead. The heat map stage reads the counts,
+/// totals them into a small buffer and clears the image for the next frame.
+/// Totals are read back once their fence has passed, so the readback never
+/// stalls; a frame's totals are dropped if the GPU is still behind.
+class OverdrawMap {
+  static constexpr int SLOTS = 3;
+
+  struct Totals {
+    GLuint fragments;
+    GLuint covered;
+    GLuint max;
+  };
+
+  struct Slot {
+    GLuint buffer;
+    GLsync fence;
+    int pixels;
+  };
+
+  GLuint mTexture {};
+  glm::ivec2 mSize { 1, 1 };
+
+  Slot mSlots[SLOTS] {};
+  int mCurrent = 0;
+  bool mResolved = false;
+
+  float mAverage = 0.0f;
+  float mCoveredAverage = 0.0f;
+  GLuint mMax = 0;
+
+  void collect(Slot &slot);
+
+public:
+  // Image unit of the counts, and buffer binding of the totals. Must match
+  // overdraw.fs.glsl and overdraw.cs.glsl.
+  static constexpr int IMAGE_UNIT = 3;
+  static constexpr auto binding = 7;
+
+  ~OverdrawMap();
+
+  /// Reallocates the counts for the given framebuffer size
+  void resize(int width, int height);
+
+  /// Binds the counts for the scene's fragment shaders, and picks up the
+  /// totals that are ready
+  void begin();
+
+  /// Makes the scene's counts visible to the heat map stage and binds the
+  /// buffer its totals go to. Runs right before the stage.
+  void resolve();
+
+  /// Fragments per pixel, over the whole frame
+  float average() const
+  {
+    return mAverage;
+  }
+
+  /// Fragments per pixel, over the pixels covered at least once
+  float coveredAverage() const
+  {
+    return mCoveredAverage;
+  }
+
+  /// Fragments of the most drawn pixel
+  GLuint maximum() const
+  {
+    return mMax;
+  }
+};
+
+#endif //__INF251_OVERDRAWMAP__63094172
@@ -0,0 +1,115 @@
+#include "PassTimer.hh"
+#include "ShaderStorage.hh"
+
+namespace {
+  // Weight of the newest result in the running average
+  constexpr float SMOOTHING = 0.1f;
+
+  const char *PASS_NAMES[] = {
+    "terrain",
+    "objects",
+    "skybox",
+    "culling",
+    "post",
+    "blit",
+  };
+}
+
+constexpr int PassTimer::FRAMES;
+
+const char *PassTimer::name(Pass pass)
+{
+  return PASS_NAMES[pass];
+}
+
+PassTimer::~PassTimer()
+{
+  for (auto &frame : mFrames) {
+    if (!frame.queries.empty())
+      gl->glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+  }
+}
+
+void PassTimer::collect(FrameQueries &frame)
+{
+  if (frame.used == 0)
+    return;
+
+  // Queries finish in order, so the last one tells for the whole frame
+  GLint available = 0;
+  gl->glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+  if (available) {
+    GLuint64 elapsed[PASSES] {};
+    for (size_t i = 0; i < frame.used; ++i) {
+      GLuint64 time = 0;
+      gl->glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &time);
+      elapsed[frame.passes[i]] += time;
+    }
+
+    mLastFrame = frame.frame;
+    mLastTotal = 0.0f;
+    for (int pass = 0; pass < PASSES; ++pass) {
+      auto ms = static_cast<float>(elapsed[pass]) / 1e6f;
+      mMilliseconds[pass] += (ms - mMilliseconds[pass]) * SMOOTHING;
+      mLastTotal += ms;
+    }
+  }
+
+  frame.used = 0;
+}
+
+void PassTimer::frame()
+{
+  end();
+
+  mCurrent = (mCurrent + 1) % FRAMES;
+  collect(mFrames[mCurrent]);
+  mFrames[mCurrent].frame = Storage::frame();
+}
+
+void PassTimer::begin(Pass pass)
+{
+  end();
+
+  auto &frame = mFrames[mCurrent];
+  if (frame.used == frame.queries.size()) {
+    GLuint query = 0;
+    gl->glGenQueries(1, &query);
+    frame.queries.push_back(query);
+    frame.passes.push_back(pass);
+  }
+
+  frame.passes[frame.used] = pass;
+  gl->glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.used]);
+  frame.used++;
+  mActive = true;
+}
+
+void PassTimer::end()
+{
+  if (!mActive)
+    return;
+
+  gl->glEndQuery(GL_TIME_ELAPSED);
+  mActive = false;
+}
+
+float PassTimer::total() const
+{
+  float sum = 0.0f;
+  for (auto ms : mMilliseconds)
+    sum += ms;
+
+  return sum;
+}
+
+std::string PassTimer::summary() const
+{
+  std::string text = fmt::format("GPU: {:.2f} ms (", total());
+  for (int pass = 0; pass < PASSES; ++pass) {
+    text += fmt::format("{}{} {:.2f}", pass ? ", " : "", PASS_NAMES[pass], mMilliseconds[pass]);
+  }
+
+  return text + ")";
+}
@@ -0,0 +1,86 @@
+#ifndef __INF251_PASSTIMER__81540327
+#define __INF251_PASSTIMER__81540327
+
+#include <string>
+#include <vector>
+#include "infdef.hh"
+
+/// Measures the GPU time of each render pass with GL_TIME_ELAPSED queries
+///
+/// A pass may be timed several times in a frame, and its times are summed.
+/// Only one pass is timed at a time, so starting a pass ends the one before.
+/// The queries are double-buffered: a frame's set is read back when it is
+/// about to be reused, two frames later, and dropped if the GPU is still
+/// behind.
+class PassTimer {
+public:
+  enum Pass {
+    TERRAIN,
+    OBJECTS,
+    SKYBOX,
+    CULLING,
+    POSTPROCESS,
+    BLIT,
+    PASSES
+  };
+
+private:
+  static constexpr int FRAMES = 2;
+
+  struct FrameQueries {
+    std::vector<GLuint> queries;
+    std::vector<Pass> passes;
+    size_t used = 0;
+    uint64_t frame = 0;
+  };
+
+  FrameQueries mFrames[FRAMES];
+  int mCurrent = 0;
+  bool mActive = false;
+
+  float mMilliseconds[PASSES] {};
+
+  // The newest frame read back, and its unsmoothed total
+  uint64_t mLastFrame = 0;
+  float mLastTotal = 0.0f;
+
+  void collect(FrameQueries &frame);
+
+public:
+  ~PassTimer();
+
+  static const char *name(Pass pass);
+
+  /// Starts a new frame of queries, and picks up the results of the frame
+  /// that last used them
+  void frame();
+
+  void begin(Pass pass);
+  void end();
+
+  /// GPU time of a pass, averaged over the last few results
+  float milliseconds(Pass pass) const
+  {
+    return mMilliseconds[pass];
+  }
+
+  /// Total GPU time of all passes
+  float total() const;
+
+  /// Storage::frame() of the newest frame read back, or 0 if there is none
+  uint64_t lastFrame() const
+  {
+    return mLastFrame;
+  }
+
+  /// Total GPU time of lastFrame(), without averaging
+  float lastTotal() const
+  {
+    return mLastTotal;
+  }
+
+  /// The times of all passes, for the status bar
+  std::string summary() const;
+};
+
+#endif //__INF251_PASSTIMER__81540327
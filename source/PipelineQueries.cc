@@ -0,0 +1,58 @@
+#include "PipelineQueries.hh"
+
+constexpr int PipelineQueries::QUERIES;
+
+PipelineQueries::~PipelineQueries()
+{
+  if (mSamplesQueries[0]) {
+    gl->glDeleteQueries(QUERIES, mSamplesQueries);
+    gl->glDeleteQueries(QUERIES, mPrimitivesQueries);
+  }
+}
+
+void PipelineQueries::collect(int index)
+{
+  if (!mPending[index])
+    return;
+
+  for (auto query : { mSamplesQueries[index], mPrimitivesQueries[index] }) {
+    GLint available = 0;
+    gl->glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+  }
+
+  gl->glGetQueryObjectuiv(mSamplesQueries[index], GL_QUERY_RESULT, &mSamples);
+  gl->glGetQueryObjectuiv(mPrimitivesQueries[index], GL_QUERY_RESULT, &mPrimitives);
+  mPending[index] = false;
+}
+
+void PipelineQueries::begin()
+{
+  if (!mSamplesQueries[0]) {
+    gl->glGenQueries(QUERIES, mSamplesQueries);
+    gl->glGenQueries(QUERIES, mPrimitivesQueries);
+  }
+
+  for (int i = 1; i <= QUERIES; ++i)
+    collect((mCurrent + i) % QUERIES);
+
+  mCurrent = (mCurrent + 1) % QUERIES;
+  mActive = !mPending[mCurrent];
+  if (!mActive)
+    return;
+
+  gl->glBeginQuery(GL_SAMPLES_PASSED, mSamplesQueries[mCurrent]);
+  gl->glBeginQuery(GL_PRIMITIVES_GENERATED, mPrimitivesQueries[mCurrent]);
+}
+
+void PipelineQueries::end()
+{
+  if (!mActive)
+    return;
+
+  gl->glEndQuery(GL_PRIMITIVES_GENERATED);
+  gl->glEndQuery(GL_SAMPLES_PASSED);
+  mPending[mCurrent] = true;
+  mActive = false;
+}
@@ -0,0 +1,48 @@
+#ifndef __INF251_PIPELINEQUERIES__25830694
+#define __INF251_PIPELINEQUERIES__25830694
+
+#include "infdef.hh"
+
+/// Counts the samples that pass the depth test and the primitives generated
+/// by the draws between begin() and end(), with GL_SAMPLES_PASSED and
+/// GL_PRIMITIVES_GENERATED queries
+///
+/// Like OverdrawCounter, results are picked up a couple of frames late, and
+/// a frame is skipped if its queries are still in flight. Only one
+/// GL_SAMPLES_PASSED query can be active, so this can't be nested in an
+/// OverdrawCounter.
+class PipelineQueries {
+  static constexpr int QUERIES = 3;
+
+  GLuint mSamplesQueries[QUERIES] {};
+  GLuint mPrimitivesQueries[QUERIES] {};
+  bool mPending[QUERIES] {};
+  int mCurrent = 0;
+  bool mActive = false;
+
+  GLuint mSamples = 0;
+  GLuint mPrimitives = 0;
+
+  void collect(int index);
+
+public:
+  ~PipelineQueries();
+
+  void begin();
+
+  void end();
+
+  /// Samples passed in the newest result
+  GLuint samples() const
+  {
+    return mSamples;
+  }
+
+  /// Primitives generated in the newest result, before clipping and culling
+  GLuint primitives() const
+  {
+    return mPrimitives;
+  }
+};
+
+#endif //__INF251_PIPELINEQUERIES__25830694
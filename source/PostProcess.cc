@@ -0,0 +1,213 @@
+#include <algorithm>
+#include "PostProcess.hh"
+#include "RenderStats.hh"
+
+namespace {
+  const struct {
+    const char *input;
+    const char *uniform;
+  } _inputs[] = {
+    { "color", "uFramebuffer" },
+    { "normal", "uNormalbuffer" },
+    { "depth", "uDepthbuffer" },
+    { "lineardepth", "uDepth" },
+    { "pyramid", "uDepthPyramid" },
+  };
+
+  // Must match the work group size of compute stages
+  constexpr int GROUP_SIZE = 16;
+
+  GLuint groups(int size)
+  {
+    return (size + GROUP_SIZE - 1) / GROUP_SIZE;
+  }
+
+  const char *uniformFor(const std::string &input)
+  {
+    for (const auto &entry : _inputs) {
+      if (input == entry.input)
+        return entry.uniform;
+    }
+
+    fatal("Unknown post-process input \"{}\"", input);
+    return nullptr;
+  }
+}
+
+PostProcess::~PostProcess()
+{
+  for (auto &target : mTargets) {
+    if (target.framebuffer)
+      gl->glDeleteFramebuffers(1, &target.framebuffer);
+    if (target.texture)
+      gl->glDeleteTextures(1, &target.texture);
+  }
+}
+
+void PostProcess::setSource(const std::string &name, GLuint texture, Sampler2D unit)
+{
+  uniformFor(name);
+  mSources.erase(name);
+  mSources.emplace(name, Source { texture, unit });
+}
+
+void PostProcess::resize(int width, int height)
+{
+  mSize = { std::max(width, 1), std::max(height, 1) };
+}
+
+void PostProcess::bindInputs(Shader &shader, const std::vector<std::string> &inputs)
+{
+  for (const auto &input : inputs) {
+    if (!mSources.count(input))
+      fatal("Post-process input \"{}\" of \"{}\" has no source", input, shader.name());
+
+    shader.uniform(uniformFor(input)) = mSources.at(input).unit;
+  }
+}
+
+void PostProcess::add(std::shared_ptr<Shader> shader,
+                      std::vector<std::string> inputs,
+                      float scale,
+                      std::function<void()> prepare)
+{
+  bindInputs(*shader, inputs);
+  mStages.push_back({ shader, std::move(inputs), scale, std::move(prepare), false });
+}
+
+void PostProcess::addCompute(std::shared_ptr<Shader> shader,
+                             std::vector<std::string> inputs,
+                             float scale,
+                             std::function<void()> prepare)
+{
+  bindInputs(*shader, inputs);
+  mStages.push_back({ shader, std::move(inputs), scale, std::move(prepare), true });
+}
+
+void PostProcess::clear()
+{
+  mStages.clear();
+}
+
+bool PostProcess::uses(const std::string &input) const
+{
+  for (const auto &stage : mStages) {
+    if (std::find(stage.inputs.begin(), stage.inputs.end(), input) != stage.inputs.end())
+      return true;
+  }
+
+  return false;
+}
+
+void PostProcess::allocate(Target &target, glm::ivec2 size)
+{
+  if (target.texture && target.size == size)
+    return;
+
+  if (!target.framebuffer)
+    gl->glGenFramebuffers(1, &target.framebuffer);
+  if (!target.texture)
+    gl->glGenTextures(1, &target.texture);
+
+  // Scaled stages are read back at a different size, so filter linearly
+  gl->glBindTexture(GL_TEXTURE_2D, target.texture);
+  gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+  gl->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+  if (gl->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    fatal("Post-process target of {}x{} is incomplete", size.x, size.y);
+
+  target.size = size;
+}
+
+void PostProcess::run()
+{
+  if (mStages.empty())
+    return;
+
+  GLint output;
+  GLint viewport[4];
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+  gl->glGetIntegerv(GL_VIEWPORT, viewport);
+
+  gl->glDisable(GL_DEPTH_TEST);
+
+  const auto &color = mSources.at("color");
+  GLuint input = color.texture;
+
+  for (size_t i = 0; i < mStages.size(); ++i) {
+    const auto &stage = mStages[i];
+    bool last = i + 1 == mStages.size();
+
+    // Allocating a target disturbs the active texture unit, so do it before
+    // binding the input there
+    gl->glActiveTexture(GL_TEXTURE0 + color.unit.index);
+
+    glm::ivec2 size = mSize;
+    if (!last)
+      size = glm::max(glm::ivec2(glm::vec2(mSize) * stage.scale), glm::ivec2(1));
+
+    // Compute stages can't write to the output directly, so the last one
+    // gets a target too
+    Target *target = nullptr;
+    if (!last || stage.compute) {
+      target = &mTargets[i % 2];
+      allocate(*target, size);
+    }
+
+    gl->glBindTexture(GL_TEXTURE_2D, input);
+    RenderStats::add(RenderStats::TEXTURE_BINDS);
+
+    if (stage.prepare)
+      stage.prepare();
+
+    stage.shader->uniform("uScreenSize") = glm::vec2(size);
+
+    if (stage.compute) {
+      stage.shader->use();
+      gl->glBindImageTexture(0, target->texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+      gl->glDispatchCompute(groups(size.x), groups(size.y), 1);
+
+      // The next stage samples the result, or the blit below reads it
+      gl->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+      if (last) {
+        gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, target->framebuffer);
+        gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+        RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+        gl->glBlitFramebuffer(0, 0, size.x, size.y,
+                              viewport[0], viewport[1],
+                              viewport[0] + viewport[2], viewport[1] + viewport[3],
+                              GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        gl->glBindFramebuffer(GL_FRAMEBUFFER, output);
+        RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+      }
+    } else {
+      gl->glBindFramebuffer(GL_FRAMEBUFFER, target ? target->framebuffer : output);
+      RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+      if (target)
+        gl->glViewport(0, 0, size.x, size.y);
+      else
+        gl->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+      stage.shader->use();
+
+      // The triangles are defined in the postprocessor's vertex shader
+      gl->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+      RenderStats::draw(2);
+    }
+
+    if (target)
+      input = target->texture;
+  }
+
+  // Leave the scene's colour where the rest of the renderer expects it
+  gl->glActiveTexture(GL_TEXTURE0 + color.unit.index);
+  gl->glBindTexture(GL_TEXTURE_2D, color.texture);
+  RenderStats::add(RenderStats::TEXTURE_BINDS);
+}
@@ -0,0 +1,92 @@
+#ifndef __INF251_POSTPROCESS__58203617
+#define __INF251_POSTPROCESS__58203617
+
+#include <functional>
+#include <map>
+#include "Shader.hh"
+
+/// A chain of full-screen effects, run in order. Every stage but the last
+/// renders into one of two ping-pong targets, at its own fraction of the
+/// framebuffer resolution. The last stage always renders at full resolution
+/// into the framebuffer bound when run() is called.
+///
+/// Stages declare the inputs they read by name, and the chain binds them to
+/// the matching sampler uniforms:
+///  - "color":  uFramebuffer, the previous stage's output, or the scene
+///  - "normal": uNormalbuffer, the scene's normals
+///  - "depth":  uDepthbuffer, the scene's depth
+///  - "lineardepth": uDepth, the scene's depth in view space units
+///  - "pyramid": uDepthPyramid, min/max linear depth mips, see DepthPyramid
+///
+/// uScreenSize is set to the size of the stage's output. The background is
+/// left to the stages: they pass their input through where the depth is 1.
+///
+/// Compute stages store their output through the rgba8 image at binding 0,
+/// with one invocation per pixel in 16x16 work groups. When the last stage is
+/// a compute stage, its output is blitted into the framebuffer.
+class PostProcess {
+  struct Source {
+    GLuint texture;
+    Sampler2D unit;
+  };
+
+  struct Stage {
+    std::shared_ptr<Shader> shader;
+    std::vector<std::string> inputs;
+    float scale;
+    std::function<void()> prepare;
+    bool compute;
+  };
+
+  struct Target {
+    GLuint framebuffer;
+    GLuint texture;
+    glm::ivec2 size;
+  };
+
+  std::map<std::string, Source> mSources;
+  std::vector<Stage> mStages;
+  Target mTargets[2] {};
+  glm::ivec2 mSize { 1, 1 };
+
+  void allocate(Target &target, glm::ivec2 size);
+
+  void bindInputs(Shader &shader, const std::vector<std::string> &inputs);
+
+public:
+  ~PostProcess();
+
+  /// Makes a scene buffer available as the named input. The texture must
+  /// stay bound to the given unit outside of run().
+  void setSource(const std::string &name, GLuint texture, Sampler2D unit);
+
+  /// Size of the framebuffer the last stage renders into
+  void resize(int width, int height);
+
+  /// Appends a stage. `prepare` runs right before the stage draws, with its
+  /// inputs bound, for effects that need passes of their own.
+  void add(std::shared_ptr<Shader> shader,
+           std::vector<std::string> inputs,
+           float scale = 1.0f,
+           std::function<void()> prepare = {});
+
+  /// Appends a compute shader stage
+  void addCompute(std::shared_ptr<Shader> shader,
+                  std::vector<std::string> inputs,
+                  float scale = 1.0f,
+                  std::function<void()> prepare = {});
+
+  void clear();
+
+  /// Whether any stage reads the named input
+  bool uses(const std::string &input) const;
+
+  bool empty() const
+  {
+    return mStages.empty();
+  }
+
+  void run();
+};
+
+#endif //__INF251_POSTPROCESS__58203617
@@ -0,0 +1,189 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Profiler.hh"
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // Events are stored in chunks, allocated as a thread needs them. The
+  // limit per thread is enough for a few minutes of frames.
+  constexpr size_t CHUNK_EVENTS = 4096;
+  constexpr size_t MAX_CHUNKS = 64;
+
+  enum struct EventType : uint8_t {
+    zone,
+    counter,
+    frame,
+  };
+
+  struct Event {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+    double value;
+    EventType type;
+  };
+
+  // Written only by its thread. `count` is published with release stores, so
+  // the writer of the trace sees complete events and chunks.
+  struct ThreadBuffer {
+    std::unique_ptr<Event[]> chunks[MAX_CHUNKS];
+    std::atomic<size_t> count { 0 };
+    std::atomic<size_t> dropped { 0 };
+    std::atomic<const char *> name { nullptr };
+    int id = 0;
+  };
+
+  std::atomic<bool> _enabled { false };
+  const auto _epoch = Clock::now();
+
+  // Buffers outlive their threads, so that short-lived loader threads still
+  // show up in the trace
+  std::mutex _buffersMutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+
+  thread_local ThreadBuffer *_buffer = nullptr;
+
+  uint64_t now() {
+    return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _epoch).count());
+  }
+
+  ThreadBuffer &threadBuffer() {
+    if (!_buffer) {
+      std::lock_guard<std::mutex> lock(_buffersMutex);
+      _buffers.emplace_back(new ThreadBuffer);
+      _buffer = _buffers.back().get();
+      _buffer->id = static_cast<int>(_buffers.size());
+    }
+
+    return *_buffer;
+  }
+
+  void record(const Event &event) {
+    auto &buffer = threadBuffer();
+    auto index = buffer.count.load(std::memory_order_relaxed);
+    if (index == CHUNK_EVENTS * MAX_CHUNKS) {
+      buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    auto &chunk = buffer.chunks[index / CHUNK_EVENTS];
+    if (!chunk)
+      chunk.reset(new Event[CHUNK_EVENTS]);
+
+    chunk[index % CHUNK_EVENTS] = event;
+    buffer.count.store(index + 1, std::memory_order_release);
+  }
+
+  // Names are literals from our own code, but escape them anyway
+  std::string escape(const char *text) {
+    std::string result;
+    for (auto c = text; *c; ++c) {
+      if (*c == '"' || *c == '\\')
+        result += '\\';
+      result += *c;
+    }
+    return result;
+  }
+}
+
+namespace Profiler {
+  void setEnabled(bool enabled) {
+    _enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  bool enabled() {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  void setThreadName(const char *name) {
+    if (enabled())
+      threadBuffer().name.store(name, std::memory_order_release);
+  }
+
+  void counter(const char *name, double value) {
+    if (enabled())
+      record({ name, now(), 0, value, EventType::counter });
+  }
+
+  void frame() {
+    if (enabled())
+      record({ "frame", now(), 0, 0.0, EventType::frame });
+  }
+
+  Zone::Zone(const char *name) :
+    mName(enabled() ? name : nullptr),
+    mStart(mName ? now() : 0)
+  {
+  }
+
+  Zone::~Zone() {
+    if (mName)
+      record({ mName, mStart, now() - mStart, 0.0, EventType::zone });
+  }
+
+  bool writeTrace(const std::string &path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+      println(stderr, "Couldn't write trace to {}", path);
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_buffersMutex);
+
+    size_t events = 0;
+    size_t dropped = 0;
+    bool first = true;
+    auto separator = [&first, &file]() {
+      if (!first)
+        file << ",\n";
+      first = false;
+    };
+
+    // Times are in microseconds
+    fmt::print(file, "{{\"traceEvents\":[\n");
+    for (const auto &buffer : _buffers) {
+      auto name = buffer->name.load(std::memory_order_acquire);
+      if (name) {
+        separator();
+        fmt::print(file, R"({{"ph":"M","pid":1,"tid":{},"name":"thread_name","args":{{"name":"{}"}}}})",
+                   buffer->id, escape(name));
+      }
+
+      auto count = buffer->count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < count; ++i) {
+        const auto &event = buffer->chunks[i / CHUNK_EVENTS][i % CHUNK_EVENTS];
+        separator();
+
+        switch (event.type) {
+          case EventType::zone:
+            fmt::print(file, R"({{"ph":"X","pid":1,"tid":{},"name":"{}","ts":{:.3f},"dur":{:.3f}}})",
+                       buffer->id, escape(event.name), event.start / 1e3, event.duration / 1e3);
+            break;
+
+          case EventType::counter:
+            fmt::print(file, R"({{"ph":"C","pid":1,"tid":{},"name":"{}","ts":{:.3f},"args":{{"value":{}}}}})",
+                       buffer->id, escape(event.name), event.start / 1e3, event.value);
+            break;
+
+          case EventType::frame:
+            fmt::print(file, R"({{"ph":"i","s":"g","pid":1,"tid":{},"name":"{}","ts":{:.3f}}})",
+                       buffer->id, escape(event.name), event.start / 1e3);
+            break;
+        }
+      }
+
+      events += count;
+      dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    fmt::print(file, "\n]}}\n");
+
+    println("Wrote {} trace events to {} ({} dropped)", events, path, dropped);
+    return true;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef __INF251_PROFILER__71946203
+#define __INF251_PROFILER__71946203
+
+#include <string>
+#include "infdef.hh"
+
+/// Records scoped zones, counters and frame markers from any thread, and
+/// writes them as Chrome trace_event JSON, for chrome://tracing or Perfetto
+///
+/// Each thread appends to its own buffer without locking; events past the
+/// end of a full buffer are dropped and counted. Names must be
+/// string literals, since only the pointers are kept. While recording is
+/// off, a zone costs one relaxed atomic load.
+namespace Profiler {
+  void setEnabled(bool enabled);
+  bool enabled();
+
+  /// Names the calling thread in the trace, if recording
+  void setThreadName(const char *name);
+
+  void counter(const char *name, double value);
+
+  /// Marks the end of a rendered frame
+  void frame();
+
+  /// Writes everything recorded so far. Returns false if the file can't be
+  /// written.
+  bool writeTrace(const std::string &path);
+
+  class Zone {
+    const char *mName;
+    uint64_t mStart;
+
+  public:
+    explicit Zone(const char *name);
+    ~Zone();
+
+    Zone(const Zone&) = delete;
+    Zone &operator=(const Zone&) = delete;
+  };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/// Times the rest of the enclosing scope
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+
+#endif //__INF251_PROFILER__71946203
@@ -0,0 +1,58 @@
+#include "RenderStats.hh"
+
+namespace {
+  const char *COUNTER_NAMES[] = {
+    "draws",
+    "primitives",
+    "programs",
+    "texture_binds",
+    "upload_bytes",
+    "framebuffer_binds",
+  };
+
+  size_t _counters[RenderStats::COUNTERS] = {};
+  size_t _lastCounters[RenderStats::COUNTERS] = {};
+
+  GLuint _program = 0;
+}
+
+void RenderStats::add(Counter counter, size_t amount)
+{
+  _counters[counter] += amount;
+}
+
+void RenderStats::draw(size_t primitives)
+{
+  _counters[DRAWS]++;
+  _counters[PRIMITIVES] += primitives;
+}
+
+void RenderStats::useProgram(GLuint program)
+{
+  if (program != _program) {
+    _counters[PROGRAMS]++;
+    _program = program;
+  }
+
+  gl->glUseProgram(program);
+}
+
+void RenderStats::nextFrame()
+{
+  _program = 0;
+
+  for (int i = 0; i < COUNTERS; ++i) {
+    _lastCounters[i] = _counters[i];
+    _counters[i] = 0;
+  }
+}
+
+size_t RenderStats::last(Counter counter)
+{
+  return _lastCounters[counter];
+}
+
+const char *RenderStats::name(Counter counter)
+{
+  return COUNTER_NAMES[counter];
+}
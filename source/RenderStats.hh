@@ -0,0 +1,43 @@
+#ifndef __INF251_RENDERSTATS__46021873
+#define __INF251_RENDERSTATS__46021873
+
+#include <cstddef>
+#include "infdef.hh"
+
+/// Counts the GL work submitted per frame: draws, primitives and the state
+/// changes between them
+///
+/// Counters are bumped at the call sites, all on the render thread, and
+/// latched once a frame by nextFrame. Primitives are what was submitted;
+/// GPU-culled draws count in full.
+namespace RenderStats {
+  enum Counter {
+    DRAWS,
+    PRIMITIVES,
+    PROGRAMS,
+    TEXTURE_BINDS,
+    UPLOAD_BYTES,
+    FRAMEBUFFER_BINDS,
+    COUNTERS
+  };
+
+  void add(Counter counter, size_t amount = 1);
+
+  /// Counts one draw call of `primitives` triangles, lines or points
+  void draw(size_t primitives);
+
+  /// Makes `program` current, counting it as a switch when it differs from
+  /// the last program bound here. All program binds go through this.
+  void useProgram(GLuint program);
+
+  /// Marks the end of a frame, latches the counters and forgets the bound
+  /// program, since the context may have been used outside of the renderer
+  void nextFrame();
+
+  /// Value of a counter during the last finished frame
+  size_t last(Counter counter);
+
+  const char *name(Counter counter);
+}
+
+#endif //__INF251_RENDERSTATS__46021873
@@ -6,19 +6,36 @@
 #include <QProgressDialog>
 #include <QApplication>
 
+#include <random>
 #include <thread>
 
 #include "LightDialog.hh"
+#include "Profiler.hh"
+#include "RenderStats.hh"
 
 namespace {
 
   constexpr int TEXTURE_LOCATION = 0;
+  constexpr int TEXTUREARRAY_LOCATION = 1;
   constexpr int BUMP_LOCATION = 2;
   constexpr int FRAMEBUFFER_LOCATION = 10;
   constexpr int NORMALBUFFER_LOCATION = 11;
   constexpr int DEPTHBUFFER_LOCATION = 12;
-  //constexpr int LINEARDEPTHBUFFER_LOCATION = 13;
+  constexpr int LINEARDEPTHBUFFER_LOCATION = 13;
   constexpr int STENCILBUFFER_LOCATION = 14;
+  constexpr int DEPTHPYRAMID_LOCATION = 17;
+
+  // Fragments per covered pixel above which the depth pre-pass is switched
+  // on, and below which it is switched off again
+  constexpr float PREPASS_ON = 1.6f;
+  constexpr float PREPASS_OFF = 1.3f;
+
+  // Shader menu entry that draws the overdraw heat map
+  constexpr int OVERDRAW_MODE = 7;
+
+  // The sun and the two movable lights come first, then the city lights
+  constexpr int USER_LIGHTS = 3;
+  constexpr int CITY_LIGHTS = 256;
 
   bool moveLights = true;
   float ambientLevel = 0.4f;
@@ -35,13 +52,37 @@ namespace {
   GLuint frameBufferTexture;
   GLuint normalBufferTexture;
   GLuint depthBufferTexture;
-  //GLuint linearDepthBufferTexture;
 
   float _lightAngle{};
   float _lightTilt{};
   float _tiltFactor{ 0.01f };
 
+  // The mode last passed to setShader, to rebuild the post-process chain
+  int _shaderMode = 0;
+  bool _computeToon = false;
+
+  // Whether the depth pre-pass may be used, and whether it currently is
+  bool _autoPrepass = true;
+  bool _prepass = false;
+
+  bool _occlusionCulling = false;
+
+  // CPU time spent in paintGL, averaged like the GPU pass times
+  float _cpuMilliseconds = 0.0f;
+
+  // Draws skipped last frame because of failed bounding box queries
+  size_t _skippedDraws = 0;
+
+  // Whether the normal buffer is attached to the scene framebuffer
+  bool _normalsAttached = true;
+
+  // Light counts for the object shader permutations, refreshed every frame
+  ShaderFeatures lightFeatures;
+
   QElapsedTimer timer;
+
+  // Runs from initializeGL until the first frame is finished
+  QElapsedTimer startupTimer;
   std::string fpsText = "FPS: 0";
   uint32_t fpsCount = 0;
 }
@@ -56,16 +97,30 @@ Renderer::Renderer(QWidget *parent) :
   gridShader = std::make_shared<Shader>();
   lineShader = std::make_shared<Shader>();
 
+  prepassShader = std::make_shared<Shader>();
+  coverageShader = std::make_shared<Shader>();
+  bboxShader = std::make_shared<Shader>();
+
   toonShader = std::make_shared<Shader>();
+  toonComputeShader = std::make_shared<Shader>();
   depthShader = std::make_shared<Shader>();
   fogShader = std::make_shared<Shader>();
-  identityShader = std::make_shared<Shader>();
+  overdrawShader = std::make_shared<Shader>();
+  heatMapShader = std::make_shared<Shader>();
 
   water = std::make_shared<Texture>();
   bump = std::make_shared<Texture>();
   bergen = std::make_shared<Texture>();
 }
 
+void Renderer::renderFrame() {
+  makeCurrent();
+  paintGL();
+
+  // Nothing swaps the buffers, so make sure the commands get going
+  glFlush();
+}
+
 void Renderer::checkAndLoadUniforms() {
   if (camera.viewDirty) {
     matrixBuffer->view = camera.rotation();
@@ -74,7 +129,8 @@ void Renderer::checkAndLoadUniforms() {
 
     Vec3 position = camera.eyePosition();
     auto strPos = fmt::format("X:{} Y:{} Z:{}", position.x, position.y, position.z);
-    lblPosition->setText(strPos.c_str());
+    if (lblPosition)
+      lblPosition->setText(strPos.c_str());
   }
 
   if (camera.projectionDirty) {
@@ -138,6 +194,17 @@ void Renderer::updateModels() {
     _tiltFactor *= -1.0f;
   }
 
+  lightFeatures.directionalLights = 0;
+  lightFeatures.pointLights = 0;
+  lightFeatures.spotLights = 0;
+  for (size_t i = 0; i < lightBuffer.size(); ++i) {
+    switch (lightBuffer[i].type) {
+      case 1: lightFeatures.directionalLights++; break;
+      case 2: lightFeatures.pointLights++; break;
+      case 3: lightFeatures.spotLights++; break;
+    }
+  }
+
   lightBuffer.update();
 }
 
@@ -161,68 +228,146 @@ void Renderer::setAllShaders(std::shared_ptr<Shader> shader) {
   //}
 }
 
-void Renderer::drawAll() {
-  gl->glEnable(GL_STENCIL_TEST);
-  gl->glStencilFunc(GL_ALWAYS, 1, 0xff);
-  gl->glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-  gl->glStencilMask(0xff);
-  gl->glClear(GL_STENCIL_BUFFER_BIT);
-
+void Renderer::forEachObject(const std::function<void(Object &)> &fn) {
   switch (currentModel) {
     case BERGEN_LOW:
     case BERGEN_MID:
     case BERGEN_HI:
     default:
-      terrain.draw();
-      grieghallen.draw();
+      fn(terrain);
+      fn(grieghallen);
       break;
 
     case SUZY_BUMP:
     case SUZY_WATER:
-      bigSuzy.draw();
+      fn(bigSuzy);
       break;
   }
 
   if (lightBuffer[1].type != 0) {
-    suzanne1.draw();
+    fn(suzanne1);
   }
   if (lightBuffer[2].type != 0) {
-    suzanne2.draw();
+    fn(suzanne2);
+  }
+}
+
+void Renderer::drawAll(bool depthOnly) {
+  if (depthOnly)
+    prepassShader->use();
+
+  bool queries = !depthOnly && _shaderMode == OVERDRAW_MODE;
+
+  for (auto object : frustum.visible()) {
+    passTimer.begin(object == &terrain ? PassTimer::TERRAIN : PassTimer::OBJECTS);
+    if (queries)
+      objectQueries[object].begin();
+
+    if (depthOnly)
+      object->drawDepth(*prepassShader);
+    else
+      object->draw(lightFeatures);
+
+    if (queries)
+      objectQueries[object].end();
+  }
+}
+
+bool Renderer::basicShading() const {
+  // The height mode still draws the buildings with the basic shader
+  return mObjectShader == basicShader || mObjectShader == heightShader;
+}
+
+// Shading is only worth saving when many fragments are hidden, so the
+// pre-pass follows the measured overdraw. It is measured on whichever pass
+// tests with GL_LESS, which passes the same fragments either way. Only the
+// basic shader's light loop costs enough for the pre-pass to pay off.
+void Renderer::drawScene() {
+  // The heat map shows the overdraw the pre-pass would hide, and the object
+  // queries can't run inside the overdraw counter's
+  if (_shaderMode == OVERDRAW_MODE) {
+    drawAll();
+    return;
+  }
+
+  bool prepass = _prepass && basicShading();
+  if (!prepass) {
+    overdraw.begin();
+    drawAll();
+    overdraw.end();
+  } else {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    overdraw.begin();
+    drawAll(true);
+    overdraw.end();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // Only the nearest fragment of each pixel is shaded
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    drawAll();
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
   }
 
-  gl->glDisable(GL_STENCIL_TEST);
+  // Overdraw is per covered pixel. A quad on the far plane passes the depth
+  // test once wherever the scene is nearer.
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDepthFunc(GL_GREATER);
+  coverageShader->use();
+  overdraw.beginCoverage();
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  overdraw.endCoverage();
+  RenderStats::draw(2);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  auto threshold = prepass ? PREPASS_OFF : PREPASS_ON;
+  _prepass = _autoPrepass && basicShading() && overdraw.overdraw() > threshold;
 }
 
 void Renderer::setModelRotation(bool rotate) {
   rotateModel = rotate;
 }
 
+const char *Renderer::terrainFile(Renderer::Model model) {
+  switch (model) {
+    case BERGEN_LOW:
+    default:
+      return "bergen_1024x918.bin";
+    case BERGEN_MID:
+      return "bergen_2048x1836.bin";
+    case BERGEN_HI:
+      return "bergen_3072x2754.bin";
+    case SUZY_BUMP:
+    case SUZY_WATER:
+      return nullptr;
+  }
+}
+
 void Renderer::setModel(Renderer::Model model) {
   if (currentModel == model) {
     return;
   }
 
+  loadModel(model);
+}
+
+void Renderer::loadModel(Renderer::Model model) {
+  PROFILE_ZONE("Renderer::loadModel");
   currentModel = model;
   loading = true;
   repaint();
 
   switch (model) {
     case BERGEN_LOW:
-    default:
-    {
-      terrain.load("bergen_1024x918.bin");
-      break;
-    }
     case BERGEN_MID:
-    {
-      terrain.load("bergen_2048x1836.bin");
-      break;
-    }
     case BERGEN_HI:
-    {
-      terrain.load("bergen_3072x2754.bin");
+    default:
+      terrain.load(terrainFile(model));
       break;
-    }
     case SUZY_BUMP:
       bigSuzy.setBump(bump);
       break;
@@ -239,8 +384,40 @@ void Renderer::rotateLights(bool move) {
   moveLights = move;
 }
 
+void Renderer::setCityLights(bool enable) {
+  for (int i = USER_LIGHTS; i < USER_LIGHTS + CITY_LIGHTS; ++i) {
+    lightBuffer[i].type = enable ? 2 : 0;
+  }
+}
+
+void Renderer::setComputeBlur(bool enable) {
+  depthOfField.useCompute = enable;
+}
+
+void Renderer::setOcclusionCulling(bool enable) {
+  _occlusionCulling = enable;
+  occlusion.invalidate();
+}
+
+// Only the objects with many draws are worth a query of their own
+void Renderer::setOcclusionQueries(bool enable) {
+  grieghallen.occlusionQuery = enable;
+  bigSuzy.occlusionQuery = enable;
+  _skippedDraws = 0;
+}
+
+void Renderer::setAutoPrepass(bool enable) {
+  _autoPrepass = enable;
+}
+
+void Renderer::setComputeToon(bool enable) {
+  _computeToon = enable;
+  setShader(_shaderMode);
+}
+
 void Renderer::setShader(int shader) {
-  shader %= 7;
+  shader %= 8;
+  _shaderMode = shader;
 
   if (shader == 4) {
     grieghallen.enableTexture = false;
@@ -255,24 +432,33 @@ void Renderer::setShader(int shader) {
     suzanne2.enableTexture = true;
     bigSuzy.enableTexture = true;
     terrain.enableTexture = true;
-    showCubemap = shader != 6;
+    showCubemap = shader != 6 && shader != OVERDRAW_MODE;
   }
 
+  postChain.clear();
+
   switch (shader) {
     case 4:
-      mPostprocessShader = toonShader;
+      if (_computeToon)
+        postChain.addCompute(toonComputeShader, { "color", "normal", "depth", "lineardepth" });
+      else
+        postChain.add(toonShader, { "color", "normal", "depth", "lineardepth" });
       break;
 
     case 5:
-      mPostprocessShader = depthShader;
+      postChain.add(depthShader, { "color", "depth", "lineardepth", "pyramid" }, 1.0f,
+                    [this] { depthOfField.blur(); });
       break;
 
     case 6:
-      mPostprocessShader = fogShader;
+      postChain.add(fogShader, { "color", "depth", "lineardepth" });
+      break;
+
+    case OVERDRAW_MODE:
+      postChain.addCompute(heatMapShader, {}, 1.0f, [this] { overdrawMap.resolve(); });
       break;
-      
+
     default:
-      mPostprocessShader = nullptr;
       break;
   }
 
@@ -289,6 +475,10 @@ void Renderer::setShader(int shader) {
       mObjectShader = heightShader;
       break;
 
+    case OVERDRAW_MODE:
+      mObjectShader = overdrawShader;
+      break;
+
     default:
       mObjectShader = basicShader;
       break;
@@ -310,6 +500,8 @@ void Renderer::setAmbient(int level) {
 }
 
 void Renderer::initializeGL() {
+  PROFILE_ZONE("Renderer::initializeGL");
+  startupTimer.start();
   initializeOpenGLFunctions();
 
 #define glReport(x) println(#x ": {}", reinterpret_cast<const char*>(glGetString(x)))
@@ -329,54 +521,75 @@ void Renderer::initializeGL() {
   lineShader->load("lines", ShaderType::object);
   lineShader->bindBuffer(matrixBuffer);
 
+  prepassShader->load("prepass");
+  prepassShader->bindBuffer(matrixBuffer);
+
+  coverageShader->load("coverage");
+
+  bboxShader->load("bbox");
+  bboxShader->bindBuffer(matrixBuffer);
+
   basicShader->load("basic", ShaderType::object);
   basicShader->bindBuffer(matrixBuffer);
   basicShader->bindBuffer(lightBuffer);
   basicShader->uniform("uTexture") = Sampler2D(TEXTURE_LOCATION);
+  basicShader->uniform("uTextureArray") = Sampler2DArray(TEXTUREARRAY_LOCATION);
   basicShader->uniform("uBump") = Sampler2D(BUMP_LOCATION);
 
   ambientShader->load("ambient", ShaderType::object);
   ambientShader->bindBuffer(matrixBuffer);
   ambientShader->bindBuffer(lightBuffer);
   ambientShader->uniform("uTexture") = Sampler2D(TEXTURE_LOCATION);
+  ambientShader->uniform("uTextureArray") = Sampler2DArray(TEXTUREARRAY_LOCATION);
   ambientShader->uniform("uBump") = Sampler2D(BUMP_LOCATION);
 
   normalsShader->load("normals", ShaderType::object);
   normalsShader->bindBuffer(matrixBuffer);
   normalsShader->bindBuffer(lightBuffer);
   normalsShader->uniform("uTexture") = Sampler2D(TEXTURE_LOCATION);
+  normalsShader->uniform("uTextureArray") = Sampler2DArray(TEXTUREARRAY_LOCATION);
   normalsShader->uniform("uBump") = Sampler2D(BUMP_LOCATION);
 
   heightShader->load("height", ShaderType::object);
   heightShader->bindBuffer(matrixBuffer);
   heightShader->bindBuffer(lightBuffer);
   heightShader->uniform("uTexture") = Sampler2D(TEXTURE_LOCATION);
+  heightShader->uniform("uTextureArray") = Sampler2DArray(TEXTUREARRAY_LOCATION);
   heightShader->uniform("uBump") = Sampler2D(BUMP_LOCATION);
 
   cubemap.load();
 
+  lightClusters.load();
+  lightClusters.resize(width(), height());
+  lightClusters.configure(*basicShader);
+
+  depthPyramid.load(DEPTHBUFFER_LOCATION, LINEARDEPTHBUFFER_LOCATION, DEPTHPYRAMID_LOCATION);
+  depthPyramid.resize(width(), height());
+  occlusion.load(DEPTHPYRAMID_LOCATION);
+
+  // Samplers and the screen size are set by the post-process chain
+  postChain.setSource("color", frameBufferTexture, FRAMEBUFFER_LOCATION);
+  postChain.setSource("normal", normalBufferTexture, NORMALBUFFER_LOCATION);
+  postChain.setSource("depth", depthBufferTexture, DEPTHBUFFER_LOCATION);
+  postChain.setSource("lineardepth", depthPyramid.linearDepth(), LINEARDEPTHBUFFER_LOCATION);
+  postChain.setSource("pyramid", depthPyramid.pyramid(), DEPTHPYRAMID_LOCATION);
+  postChain.resize(width(), height());
+
   toonShader->load("toon", ShaderType::postprocess);
-  toonShader->uniform("uFramebuffer") = Sampler2D(FRAMEBUFFER_LOCATION);
-  toonShader->uniform("uNormalbuffer") = Sampler2D(NORMALBUFFER_LOCATION);
-  toonShader->uniform("uDepthbuffer") = Sampler2D(DEPTHBUFFER_LOCATION);
-  //toonShader->uniform("uDepth") = Sampler2D(LINEARDEPTHBUFFER_LOCATION);
-  toonShader->uniform("uScreenSize") = glm::vec2(width(), height());
+  toonComputeShader->load("toon", ShaderType::compute);
 
   depthShader->load("depth", ShaderType::postprocess);
-  depthShader->uniform("uFramebuffer") = Sampler2D(FRAMEBUFFER_LOCATION);
-  depthShader->uniform("uDepthbuffer") = Sampler2D(DEPTHBUFFER_LOCATION);
-  //depthShader->uniform("uDepth") = Sampler2D(LINEARDEPTHBUFFER_LOCATION);
-  depthShader->uniform("uScreenSize") = glm::vec2(width(), height());
+
+  depthOfField.load(FRAMEBUFFER_LOCATION, LINEARDEPTHBUFFER_LOCATION);
+  depthOfField.resize(width(), height());
+  depthOfField.configure(*depthShader);
 
   fogShader->load("fog", ShaderType::postprocess);
-  fogShader->uniform("uFramebuffer") = Sampler2D(FRAMEBUFFER_LOCATION);
-  fogShader->uniform("uDepthbuffer") = Sampler2D(DEPTHBUFFER_LOCATION);
-  //fogShader->uniform("uDepth") = Sampler2D(LINEARDEPTHBUFFER_LOCATION);
-  fogShader->uniform("uScreenSize") = glm::vec2(width(), height());
 
-  identityShader->load("identity", ShaderType::postprocess);
-  identityShader->uniform("uFramebuffer") = Sampler2D(FRAMEBUFFER_LOCATION);
-  identityShader->uniform("uScreenSize") = glm::vec2(width(), height());
+  overdrawShader->load("overdraw", ShaderType::object);
+  overdrawShader->bindBuffer(matrixBuffer);
+  heatMapShader->load("overdraw", ShaderType::compute);
+  overdrawMap.resize(width(), height());
 
   grieghallen.load("grieghallen.obj");
   grieghallen.modelTransform = glm::scale(Mat4(), Vec3(0.02f, 0.02f, 0.02f));
@@ -404,6 +617,9 @@ void Renderer::initializeGL() {
   bigSuzy.setBump(bump);
 
   /* Create lights */
+  // The light dialog keeps references into the buffer, so it is sized once
+  lightBuffer.resize(USER_LIGHTS + CITY_LIGHTS);
+
   lightBuffer[0].type = 1;
   lightBuffer[0].color = { 1.0f, 1.0f, 1.0f };
   lightBuffer[0].position = { 0.0, 10.0f, 0.0f };
@@ -417,6 +633,26 @@ void Renderer::initializeGL() {
   lightBuffer[2].color = { 0.0f, 1.0f, 0.0f };
   lightBuffer[2].intensity = 0.5f;
   lightBuffer[2].aperture = 0.1f;
+
+  // Scatter small bounded point lights over the city. They start off and
+  // are toggled from the Lights menu.
+  {
+    std::mt19937 rng(251);
+    std::uniform_real_distribution<float> spread(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> height(0.5f, 2.0f);
+    std::uniform_real_distribution<float> range(4.0f, 10.0f);
+    std::uniform_real_distribution<float> tint(0.3f, 1.0f);
+
+    for (int i = USER_LIGHTS; i < USER_LIGHTS + CITY_LIGHTS; ++i) {
+      auto &light = lightBuffer[i];
+      light.type = 0;
+      light.position = { spread(rng), height(rng), spread(rng) };
+      light.color = { 1.0f, tint(rng), tint(rng) * 0.6f };
+      light.radius = range(rng);
+      light.specularIndex = 64.0f;
+    }
+  }
+
   lightBuffer.update();
 
   /* Create grid quad */
@@ -450,8 +686,6 @@ void Renderer::initializeGL() {
   glBindTexture(GL_TEXTURE_2D, normalBufferTexture);
   glActiveTexture(GL_TEXTURE0 + DEPTHBUFFER_LOCATION);
   glBindTexture(GL_TEXTURE_2D, depthBufferTexture);
-  //glActiveTexture(GL_TEXTURE0 + LINEARDEPTHBUFFER_LOCATION);
-  //glBindTexture(GL_TEXTURE_2D, linearDepthBufferTexture);
 
   setShader(0); // set to 'basic' shader
 
@@ -463,25 +697,26 @@ void Renderer::resizeGL(int width, int height) {
 
   glActiveTexture(GL_TEXTURE0 + FRAMEBUFFER_LOCATION);
   glBindTexture(GL_TEXTURE_2D, frameBufferTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 
   glActiveTexture(GL_TEXTURE0 + NORMALBUFFER_LOCATION);
   glBindTexture(GL_TEXTURE_2D, normalBufferTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, 0);
 
   glActiveTexture(GL_TEXTURE0 + DEPTHBUFFER_LOCATION);
   glBindTexture(GL_TEXTURE_2D, depthBufferTexture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 0);
 
-  //glActiveTexture(GL_TEXTURE0 + LINEARDEPTHBUFFER_LOCATION);
-  //glBindTexture(GL_TEXTURE_2D, linearDepthBufferTexture);
-  //glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, 0);
-
   glViewport(0, 0, width, height);
 
-  toonShader->uniform("uScreenSize") = glm::vec2(width, height);
-  depthShader->uniform("uScreenSize") = glm::vec2(width, height);
-  fogShader->uniform("uScreenSize") = glm::vec2(width, height);
+  lightClusters.resize(width, height);
+  lightClusters.configure(*basicShader);
+  depthOfField.resize(width, height);
+  depthPyramid.resize(width, height);
+  overdrawMap.resize(width, height);
+  occlusion.invalidate();
+
+  postChain.resize(width, height);
 }
 
 void Renderer::paintGL() {
@@ -489,13 +724,53 @@ void Renderer::paintGL() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
     return;
   }
-  camera.update();
+  PROFILE_ZONE("Renderer::paintGL");
+
+  QElapsedTimer cpuTimer;
+  cpuTimer.start();
+  passTimer.frame();
 
-  checkAndLoadUniforms();
-  updateModels();
+  {
+    PROFILE_ZONE("update");
+    camera.update();
 
-  if (mPostprocessShader) {
+    checkAndLoadUniforms();
+    updateModels();
+  }
+
+  passTimer.begin(PassTimer::CULLING);
+
+  // Only the basic shader reads the clusters
+  if (basicShading())
+    lightClusters.cull();
+
+  {
+    PROFILE_ZONE("frustum cull");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    frustum.clear();
+    forEachObject([this](Object &object) { frustum.add(object); });
+    frustum.cull(matrixBuffer->view, matrixBuffer->proj, viewport[3]);
+  }
+
+  // Occlusion culling needs the scene's depth for next frame's pyramid
+  bool offscreen = !postChain.empty() || _occlusionCulling;
+  if (offscreen) {
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+    attachNormals(postChain.uses("normal"));
+  }
+
+  if (_shaderMode == OVERDRAW_MODE)
+    overdrawMap.begin();
+
+  if (_occlusionCulling) {
+    PROFILE_ZONE("occlusion cull");
+    occlusion.begin(matrixBuffer->view, matrixBuffer->proj);
+    for (auto object : frustum.visible())
+      occlusion.cull(*object);
+    occlusion.end();
   }
 
   /* Draw grid before doing anything else */
@@ -506,42 +781,119 @@ void Renderer::paintGL() {
   glEnable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-  drawAll();
+  {
+    PROFILE_ZONE("scene");
+    drawScene();
+    queryVisibility();
+  }
 
-  if (showCubemap)
+  if (showCubemap) {
+    PROFILE_ZONE("skybox");
+    passTimer.begin(PassTimer::SKYBOX);
     cubemap.draw();
+  }
 
-  if (mPostprocessShader) {
+  if (offscreen) {
+    PROFILE_ZONE("depth pyramid");
+    passTimer.begin(PassTimer::CULLING);
     QOpenGLFramebufferObject::bindDefault();
+    RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+    depthPyramid.build();
+  }
+
+  // The background is passed through by the effects themselves
+  if (!postChain.empty()) {
+    PROFILE_ZONE("post-process");
+    passTimer.begin(PassTimer::POSTPROCESS);
+    postChain.run();
+  } else if (offscreen) {
+    passTimer.begin(PassTimer::BLIT);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
-    glBlitFramebuffer(0, 0, width(), height(), 0, 0, width(), height(), GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
+    RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBlitFramebuffer(0, 0, viewport[2], viewport[3],
+                      viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }
 
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
-    glStencilMask(0);
+  passTimer.end();
 
-    mPostprocessShader->use();
+  QOpenGLFramebufferObject::bindDefault();
+  RenderStats::add(RenderStats::FRAMEBUFFER_BINDS);
+  RenderStats::useProgram(0);
 
-    // The triangles are defined in the postprocessor's vertex shader
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  auto cpuMs = cpuTimer.nsecsElapsed() / 1e6f;
+  _cpuMilliseconds += (cpuMs - _cpuMilliseconds) * 0.1f;
+  frameStats.record(Storage::frame(), cpuMs);
+  if (passTimer.lastFrame())
+    frameStats.recordGpu(passTimer.lastFrame(), passTimer.lastTotal());
 
-    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-    identityShader->use();
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  Storage::nextFrame();
+  RenderStats::nextFrame();
 
-    glDisable(GL_STENCIL_TEST);
+  for (int i = 0; i < RenderStats::COUNTERS; ++i) {
+    auto counter = static_cast<RenderStats::Counter>(i);
+    Profiler::counter(RenderStats::name(counter), static_cast<double>(RenderStats::last(counter)));
   }
+  Profiler::counter("cpu ms", cpuMs);
+  Profiler::frame();
 
-  QOpenGLFramebufferObject::bindDefault();
-  glUseProgram(0);
+  if (startupTimer.isValid()) {
+    println("Time to first frame: {} ms", startupTimer.elapsed());
+    startupTimer.invalidate();
+  }
 
   if (timer.elapsed() >= 1000) {
-    fpsText = fmt::format("FPS: {}", fpsCount);
+    fpsText = fmt::format("FPS: {}  Uploads: {} B/frame  Overdraw: {:.2f}{}  Skipped: {} draws  Culled: {}  CPU: {:.2f} ms  {}",
+                          fpsCount, Storage::uploadedBytes(), overdraw.overdraw(),
+                          _prepass ? " (pre-pass)" : "", _skippedDraws, frustum.culled(),
+                          _cpuMilliseconds, passTimer.summary());
+
+    // Counts of the last frame, not averages
+    fpsText += fmt::format("  Draws: {}  Primitives: {}  Programs: {}  Textures: {}  Framebuffers: {}",
+                           RenderStats::last(RenderStats::DRAWS),
+                           RenderStats::last(RenderStats::PRIMITIVES),
+                           RenderStats::last(RenderStats::PROGRAMS),
+                           RenderStats::last(RenderStats::TEXTURE_BINDS),
+                           RenderStats::last(RenderStats::FRAMEBUFFER_BINDS));
+
+    if (_shaderMode == OVERDRAW_MODE) {
+      fpsText += fmt::format("  Fragments/pixel: {:.2f} ({:.2f} where covered, max {})",
+                             overdrawMap.average(), overdrawMap.coveredAverage(),
+                             overdrawMap.maximum());
+
+      const std::pair<const Object *, const char *> names[] = {
+        { &terrain, "terrain" },
+        { &grieghallen, "grieghallen" },
+        { &suzanne1, "suzanne1" },
+        { &suzanne2, "suzanne2" },
+        { &bigSuzy, "suzanne" },
+      };
+      for (auto object : frustum.visible()) {
+        for (const auto &name : names) {
+          if (name.first != object)
+            continue;
+
+          const auto &queries = objectQueries[object];
+          fpsText += fmt::format("  {}: {} samples, {} primitives",
+                                 name.second, queries.samples(), queries.primitives());
+        }
+      }
+    }
+
+    // Hitches only show up in the tail of the distribution
+    auto cpu = frameStats.cpu();
+    auto gpu = frameStats.gpu();
+    fpsText += fmt::format("  p50/p95/p99/max: CPU {:.1f}/{:.1f}/{:.1f}/{:.1f} GPU {:.1f}/{:.1f}/{:.1f}/{:.1f} ms",
+                           cpu.p50, cpu.p95, cpu.p99, cpu.max, gpu.p50, gpu.p95, gpu.p99, gpu.max);
     fpsCount = 0;
     timer.restart();
-    lblFPS->setText(fpsText.c_str());
+    if (lblFPS)
+      lblFPS->setText(fpsText.c_str());
   }
   fpsCount++;
 
@@ -564,6 +916,48 @@ void Renderer::wheelEvent(QWheelEvent *evt) {
   camera.wheelMoved(evt);
 }
 
+// Only effects that read the normals pay for writing them. Without a draw
+// buffer the object shaders' FragNormal output is discarded.
+void Renderer::attachNormals(bool attach) {
+  if (attach == _normalsAttached)
+    return;
+
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         attach ? normalBufferTexture : 0, 0);
+
+  GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, attach ? GL_COLOR_ATTACHMENT1 : GL_NONE };
+  glDrawBuffers(2, attachments);
+
+  _normalsAttached = attach;
+}
+
+// Tests the bounding boxes of the queried objects against this frame's depth,
+// for their draws in the next frame
+void Renderer::queryVisibility() {
+  auto eye = glm::vec3(glm::inverse(matrixBuffer->view)[3]);
+
+  passTimer.begin(PassTimer::CULLING);
+
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDisable(GL_CULL_FACE);
+
+  _skippedDraws = 0;
+  for (auto object : frustum.visible()) {
+    if (!object->occlusionQuery)
+      continue;
+
+    if (object->occluded())
+      _skippedDraws += object->drawCount();
+
+    object->queryVisibility(*bboxShader, eye);
+  }
+
+  glEnable(GL_CULL_FACE);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
 void Renderer::generateFrameBuffer() {
   // Color attachment
   glGenTextures(1, &frameBufferTexture);
@@ -575,9 +969,9 @@ void Renderer::generateFrameBuffer() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width(), height(), 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width(), height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 
-  // Normal attachment
+  // Normal attachment, octahedrally encoded by packNormal
   glGenTextures(1, &normalBufferTexture);
   glActiveTexture(GL_TEXTURE0 + FRAMEBUFFER_LOCATION);
   glBindTexture(GL_TEXTURE_2D, normalBufferTexture);
@@ -587,7 +981,7 @@ void Renderer::generateFrameBuffer() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width(), height(), 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width(), height(), 0, GL_RG, GL_UNSIGNED_BYTE, 0);
 
   // Depth attachment
   glGenTextures(1, &depthBufferTexture);
@@ -601,24 +995,11 @@ void Renderer::generateFrameBuffer() {
 
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width(), height(), 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 0);
 
-  // Linear depth attachment
-  //glGenTextures(1, &linearDepthBufferTexture);
-  //glActiveTexture(GL_TEXTURE0 + LINEARDEPTHBUFFER_LOCATION);
-  //glBindTexture(GL_TEXTURE_2D, linearDepthBufferTexture);
-
-  //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-  //glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width(), height(), 0, GL_RED, GL_FLOAT, 0);
-
   // Actual frame buffer
   glGenFramebuffers(1, &frameBuffer);
   glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameBufferTexture, 0);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalBufferTexture, 0);
-  //glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, linearDepthBufferTexture, 0);
   glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthBufferTexture, 0);
 
   GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
@@ -1,6 +1,7 @@
 #ifndef __INF251_RENDERER__48721384
 #define __INF251_RENDERER__48721384
 
+#include <map>
 #include <QLabel>
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions_4_3_Core>
@@ -12,6 +13,17 @@
 #include "ShaderStorage.hh"
 #include "Camera.hh"
 #include "Cubemap.hh"
+#include "LightClusters.hh"
+#include "DepthOfField.hh"
+#include "DepthPyramid.hh"
+#include "PostProcess.hh"
+#include "OverdrawCounter.hh"
+#include "OverdrawMap.hh"
+#include "PipelineQueries.hh"
+#include "PassTimer.hh"
+#include "FrameStats.hh"
+#include "OcclusionCuller.hh"
+#include "FrustumCuller.hh"
 
 class Renderer : public QOpenGLWidget, public QOpenGLFunctions_4_3_Core {
   Q_OBJECT
@@ -25,11 +37,37 @@ public:
     SUZY_WATER
   };
 
+  /// Terrain mesh in resources/meshes that the model loads, or null for
+  /// models that are drawn on the current terrain
+  static const char *terrainFile(Model model);
+
   Camera camera;
 
+  /// CPU and GPU time of the frames drawn so far
+  FrameStats frameStats;
+
   Renderer(QWidget *parent = 0);
   ~Renderer() = default;
 
+  /// Draws a frame outside of a paint event, into the widget's framebuffer.
+  /// Works on a widget that was never shown, once it is initialised.
+  void renderFrame();
+
+  /// Loads a model like setModel, but also when it is the current one, so
+  /// that every load can be timed the same way
+  void loadModel(Model model);
+
+  const PassTimer &passTimes() const
+  {
+    return passTimer;
+  }
+
+  /// Fragments per pixel of the overdraw shader mode
+  const OverdrawMap &overdrawTotals() const
+  {
+    return overdrawMap;
+  }
+
   struct LightBlock {
     static constexpr auto name = "LightBlock";
     static constexpr auto binding = 1;
@@ -41,11 +79,30 @@ public:
     float specularIndex = 256.0f;
     float aperture;
     float intensity = 1.0f;
+
+    // Distance at which the light has faded out completely. Lights with no
+    // radius reach every cluster.
+    float radius = 0.0f;
   };
 
+  // std430 offsets of LightSource in basic.fs.glsl and lightcull.cs.glsl
+  static_assert(offsetof(LightBlock, direction) == 16 &&
+                offsetof(LightBlock, color) == 32 &&
+                offsetof(LightBlock, position) == 48 &&
+                offsetof(LightBlock, specularIndex) == 60 &&
+                offsetof(LightBlock, radius) == 72 &&
+                sizeof(LightBlock) == 80,
+                "LightBlock doesn't match LightSource");
+
   public slots:
   void setModelRotation(bool rotate);
   void rotateLights(bool move);
+  void setCityLights(bool enable);
+  void setComputeBlur(bool enable);
+  void setComputeToon(bool enable);
+  void setAutoPrepass(bool enable);
+  void setOcclusionCulling(bool enable);
+  void setOcclusionQueries(bool enable);
   void setShader(int shader);
   void showPanel(int light);
   void setAmbient(int level);
@@ -81,11 +138,21 @@ private:
     glm::mat4 view;
   };
 
+  static_assert(offsetof(MatrixBlock, view) == 64 && sizeof(MatrixBlock) == 128,
+                "MatrixBlock doesn't match the GLSL block");
+
   void checkAndLoadUniforms();
   void updateModels();
   void generateFrameBuffer();
+  void attachNormals(bool attach);
   void setAllShaders(std::shared_ptr<Shader> shader);
-  void drawAll();
+  void forEachObject(const std::function<void(Object &)> &fn);
+  void drawAll(bool depthOnly = false);
+  void drawScene();
+
+  /// Whether the basic shader, with its light loop, draws any objects
+  bool basicShading() const;
+  void queryVisibility();
 
   std::shared_ptr<Shader> basicShader;
   std::shared_ptr<Shader> ambientShader;
@@ -93,13 +160,17 @@ private:
   std::shared_ptr<Shader> heightShader;
   std::shared_ptr<Shader> gridShader;
   std::shared_ptr<Shader> lineShader;
+  std::shared_ptr<Shader> prepassShader;
+  std::shared_ptr<Shader> coverageShader;
+  std::shared_ptr<Shader> bboxShader;
 
   std::shared_ptr<Shader> toonShader;
+  std::shared_ptr<Shader> toonComputeShader;
   std::shared_ptr<Shader> depthShader;
   std::shared_ptr<Shader> fogShader;
-  std::shared_ptr<Shader> identityShader;
+  std::shared_ptr<Shader> overdrawShader;
+  std::shared_ptr<Shader> heatMapShader;
 
-  std::shared_ptr<Shader> mPostprocessShader;
   std::shared_ptr<Shader> mObjectShader;
 
   std::shared_ptr<Texture> water;
@@ -113,9 +184,21 @@ private:
   Object terrain;
 
   Cubemap cubemap;
-
-  ShaderStorage<MatrixBlock> matrixBuffer;
-  ShaderStorage<LightBlock[], 12> lightBuffer;
+  LightClusters lightClusters;
+  DepthOfField depthOfField;
+  DepthPyramid depthPyramid;
+  PostProcess postChain;
+  OverdrawCounter overdraw;
+  OverdrawMap overdrawMap;
+  PassTimer passTimer;
+  OcclusionCuller occlusion;
+  FrustumCuller frustum;
+
+  // Samples and primitives of each object, in the overdraw shader mode
+  std::map<const Object *, PipelineQueries> objectQueries;
+
+  ShaderStorage<MatrixBlock, 1, ReadOnlyBuffer> matrixBuffer { StorageMode::streaming };
+  ShaderStorage<LightBlock[], 0> lightBuffer;
 
   QLabel * lblFPS = nullptr;
   QLabel * lblPosition = nullptr;
@@ -1,10 +1,34 @@
 #include "Shader.hh"
 #include "Debug.hh"
-
+#include "Profiler.hh"
+#include "RenderStats.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
 #include <QTextStream>
 
 namespace {
+  // Uniform names by slot, shared by all shaders. Function statics, so that
+  // slots can be looked up during static initialisation.
+  std::deque<std::string> &_slotNames()
+  {
+    static std::deque<std::string> names;
+    return names;
+  }
+
+  std::unordered_map<std::string, size_t> &_slots()
+  {
+    static std::unordered_map<std::string, size_t> slots;
+    return slots;
+  }
+
   auto _objectVertexShader =
     "#version 430\n"
 
@@ -16,13 +40,17 @@ namespace {
     "out vec3 fNormal;"
     "out vec3 fEyePos;"
 
-    "layout(std430, binding = 0) buffer MatrixBlock {"
+    "READONLY_BLOCK(0) MatrixBlock {"
     "  mat4 uProj;"
     "  mat4 uView;"
     "};"
 
     "uniform mat4 uModel;"
 
+    // The depth pre-pass in prepass.vs.glsl must produce the exact same
+    // positions, since shading then tests for equal depth
+    "invariant gl_Position;"
+
     "void main() {"
     "  vec4 vmp = uModel * vec4(vPosition, 1.0);"
     "  fPosition = vmp.xyz;"
@@ -43,26 +71,147 @@ namespace {
     "  gl_Position = vec4(vtx[gl_VertexID], 0.0, 1.0);"
     "}";
 
+  // Normals are stored octahedrally encoded in two unsigned normalised
+  // channels, which keeps the normal buffer at two bytes a pixel
+  auto _normalPacking =
+    "vec2 packNormal(vec3 n) {"
+    "  n /= abs(n.x) + abs(n.y) + abs(n.z);"
+    "  vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);"
+    "  vec2 p = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * s;"
+    "  return p * 0.5 + 0.5;"
+    "}"
+
+    "vec3 unpackNormal(vec2 p) {"
+    "  p = p * 2.0 - 1.0;"
+    "  vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));"
+    "  float t = max(-n.z, 0.0);"
+    "  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);"
+    "  return normalize(n);"
+    "}\n";
+
+  // Inserts preprocessor definitions right after the #version line, which
+  // GLSL requires to come first
+  std::string injectDefines(const std::string &code, const std::string &defines)
+  {
+    auto eol = code.find('\n');
+    if (code.compare(0, 8, "#version") != 0 || eol == std::string::npos)
+      return defines + code;
+
+    return code.substr(0, eol + 1) + defines + code.substr(eol + 1);
+  }
+
+  // Definitions shared by every shader we build
+  std::string commonDefines()
+  {
+    return format("#define READONLY_BLOCK(b) {}\n", ReadOnlyBuffer::declaration())
+      + _normalPacking;
+  }
+
+  // Permutation switches, in the order they are packed into variant keys.
+  // The shaders only test whether there are any lights of a type, so light
+  // counts are clamped to 1; every count would otherwise compile the same
+  // program again.
+  const struct {
+    int ShaderFeatures::*value;
+    const char *macro;
+    int max;
+  } _features[] = {
+    { &ShaderFeatures::texture, "HAVE_TEXTURE", 1 },
+    { &ShaderFeatures::bump, "HAVE_BUMP", 1 },
+    { &ShaderFeatures::directionalLights, "DIRECTIONAL_LIGHTS", 1 },
+    { &ShaderFeatures::pointLights, "POINT_LIGHTS", 1 },
+    { &ShaderFeatures::spotLights, "SPOT_LIGHTS", 1 },
+  };
+
+  constexpr size_t FEATURE_BITS = 2;
+
+  // -1 for the shader's default, otherwise clamped to the feature's range
+  int featureValue(const ShaderFeatures &features, size_t i)
+  {
+    int value = features.*_features[i].value;
+    return value < 0 ? -1 : std::min(value, _features[i].max);
+  }
+
+  // Features outside the mask are left at their defaults, so that shaders
+  // which ignore a feature don't compile identical variants for it
+  uint64_t featureKey(const ShaderFeatures &features, unsigned mask)
+  {
+    uint64_t key = 0;
+    for (size_t i = 0; i < sizeof(_features) / sizeof(*_features); ++i) {
+      int value = mask & (1u << i) ? featureValue(features, i) : -1;
+      uint64_t field = value + 1;
+      key = key << FEATURE_BITS | field;
+    }
+
+    return key;
+  }
+
+  std::string featureDefines(const ShaderFeatures &features, unsigned mask)
+  {
+    std::string defines;
+    for (size_t i = 0; i < sizeof(_features) / sizeof(*_features); ++i) {
+      int value = featureValue(features, i);
+      if (mask & (1u << i) && value >= 0)
+        defines += format("#define {} {}\n", _features[i].macro, value);
+    }
+
+    return defines;
+  }
+
+  unsigned featureMask(const std::string &source)
+  {
+    unsigned mask = 0;
+    for (size_t i = 0; i < sizeof(_features) / sizeof(*_features); ++i) {
+      if (source.find(_features[i].macro) != std::string::npos)
+        mask |= 1u << i;
+    }
+
+    return mask;
+  }
+
   // We Java now
   class ShaderBuilder {
-    std::vector<GLuint> mShaders;
-
   public:
-    ~ShaderBuilder();
-
     enum Type {
       vertex,
       tesselation,
       fragment,
+      compute,
     };
 
+  private:
+    std::vector<GLuint> mShaders;
+    std::vector<std::pair<Type, std::string>> mStages;
+    std::string mDefines;
+    std::string mSource;
+
+    void compile(const std::string &source, Type type);
+
+    QString cachePath() const;
+
+  public:
+    explicit ShaderBuilder(const std::string &defines = "");
+
+    ~ShaderBuilder();
+
     void addFile(const std::string &name, Type type, const std::string &prepend = "");
 
     void add(const std::string &code, Type type);
 
     GLuint build();
+
+    // Everything added so far, without the injected definitions
+    const std::string &source() const
+    {
+      return mSource;
+    }
   };
 
+  ShaderBuilder::ShaderBuilder(const std::string &defines) :
+    mDefines(defines)
+  {
+  }
+
   ShaderBuilder::~ShaderBuilder()
   {
     for (auto shader : mShaders)
@@ -75,6 +224,7 @@ namespace {
         "vs", // vertex
         "ts", // tesselation
         "fs", // fragment
+        "cs", // compute
     };
 
     QString filename = QString(":shaders/%1.%2.glsl")
@@ -87,21 +237,30 @@ namespace {
     add(code.toStdString(), type);
   }
 
+  // Sources are only compiled by build(), if the program cache misses
   void ShaderBuilder::add(const std::string &code, Type type)
+  {
+    mSource += code;
+    mStages.emplace_back(type, injectDefines(code, commonDefines() + mDefines));
+  }
+
+  void ShaderBuilder::compile(const std::string &source, Type type)
   {
     GLenum typeToGLenum[] = {
         GL_VERTEX_SHADER,
         0,
         GL_FRAGMENT_SHADER,
+        GL_COMPUTE_SHADER,
     };
 
     const char *typeToPretty[] = {
         "vertex",
         "tesselation",
         "fragment",
+        "compute",
     };
 
-    auto codePtr = code.data();
+    auto codePtr = source.data();
     auto codePtrPtr = &codePtr;
     auto shader = gl->glCreateShader(typeToGLenum[static_cast<int>(type)]);
     gl->glShaderSource(shader, 1, codePtrPtr, nullptr);
@@ -118,13 +277,119 @@ namespace {
     mShaders.emplace_back(shader);
   }
 
+  // Program binaries are only valid for the driver that produced them, so
+  // the key covers the driver as well as the sources
+  QString ShaderBuilder::cachePath() const
+  {
+    static const QString dir = []() -> QString {
+      GLint formats = 0;
+      gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+      auto location = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+      if (formats == 0 || location.isEmpty() || qEnvironmentVariableIsSet("GRIEG_NO_PROGRAM_CACHE"))
+        return QString();
+
+      location += "/programs";
+      if (!QDir().mkpath(location)) {
+        println(stderr, "Warning: Couldn't create program cache at {}", location.toStdString());
+        return QString();
+      }
+
+      return location;
+    }();
+
+    if (dir.isEmpty())
+      return dir;
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_VENDOR)));
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_RENDERER)));
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_VERSION)));
+    for (const auto &stage : mStages) {
+      hash.addData(reinterpret_cast<const char*>(&stage.first), sizeof(stage.first));
+      hash.addData(stage.second.data(), static_cast<int>(stage.second.size()));
+    }
+
+    return dir + "/" + QString::fromLatin1(hash.result().toHex()) + ".bin";
+  }
+
+  GLuint loadProgramBinary(const QString &path)
+  {
+    QFile file(path);
+    if (path.isEmpty() || !file.open(QFile::ReadOnly))
+      return 0;
+
+    // The binary format, followed by the binary itself
+    auto data = file.readAll();
+    GLenum binaryFormat;
+    if (data.size() <= static_cast<int>(sizeof(binaryFormat)))
+      return 0;
+
+    std::memcpy(&binaryFormat, data.constData(), sizeof(binaryFormat));
+
+    auto program = gl->glCreateProgram();
+    gl->glProgramBinary(program,
+                        binaryFormat,
+                        data.constData() + sizeof(binaryFormat),
+                        data.size() - sizeof(binaryFormat));
+
+    // Drivers reject binaries they can't use anymore, so this is not an error
+    GLint success{};
+    gl->glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+      println(stderr, "Warning: Discarding stale program binary {}", path.toStdString());
+      gl->glDeleteProgram(program);
+      file.remove();
+      return 0;
+    }
+
+    return program;
+  }
+
+  void saveProgramBinary(const QString &path, GLuint program)
+  {
+    GLint length{};
+    gl->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+      return;
+
+    GLenum binaryFormat;
+    QByteArray data(sizeof(binaryFormat) + length, Qt::Uninitialized);
+    gl->glGetProgramBinary(program, length, nullptr, &binaryFormat, data.data() + sizeof(binaryFormat));
+    std::memcpy(data.data(), &binaryFormat, sizeof(binaryFormat));
+
+    // Written atomically, so that a crash never leaves half a binary behind
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit())
+      println(stderr, "Warning: Couldn't write program binary {}", path.toStdString());
+  }
+
   GLuint ShaderBuilder::build()
   {
+    auto path = cachePath();
+    if (auto program = loadProgramBinary(path)) {
+      mStages.clear();
+      return program;
+    }
+
+    for (const auto &stage : mStages)
+      compile(stage.second, stage.first);
+
+    mStages.clear();
+
     GLuint program = gl->glCreateProgram();
 
     for (auto shader : mShaders)
       gl->glAttachShader(program, shader);
 
+    if (!path.isEmpty())
+      gl->glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    // Output locations only take effect when the program is linked
+    gl->glBindFragDataLocation(program, 0, "FragColor");
+    gl->glBindFragDataLocation(program, 1, "FragNormal");
+    //gl->glBindFragDataLocation(program, 2, "FragDepth");
+
     GLint success{};
     gl->glLinkProgram(program);
     gl->glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -139,6 +404,9 @@ namespace {
 
     mShaders.clear();
 
+    if (!path.isEmpty())
+      saveProgramBinary(path, program);
+
     return program;
   }
 }
@@ -150,68 +418,204 @@ Shader::Shader(const std::string &name, ShaderType type)
 
 Shader::~Shader()
 {
-  if (mProgram)
-    gl->glDeleteProgram(mProgram);
+  for (auto &variant : mVariants)
+    gl->glDeleteProgram(variant.second.program);
 }
 
-void Shader::load(const std::string &name, ShaderType type)
+GLuint Shader::build(const std::string &defines, std::string *source)
 {
-  GLint success = 0;
-
-  println("Loading shader: {}", name);
-  mName = name;
+  ShaderBuilder builder(defines);
 
-  ShaderBuilder builder;
-
-  switch (type) {
+  switch (mType) {
   case ShaderType::custom:
-    builder.addFile(name, ShaderBuilder::vertex);
-    builder.addFile(name, ShaderBuilder::fragment);
+    builder.addFile(mName, ShaderBuilder::vertex);
+    builder.addFile(mName, ShaderBuilder::fragment);
     break;
 
   case ShaderType::object:
     builder.add(_objectVertexShader, ShaderBuilder::vertex);
-    builder.addFile(name, ShaderBuilder::fragment);
+    builder.addFile(mName, ShaderBuilder::fragment);
     break;
 
   case ShaderType::postprocess:
     builder.add(_postprocessVertexShader, ShaderBuilder::vertex);
-    builder.addFile(name, ShaderBuilder::fragment);
+    builder.addFile(mName, ShaderBuilder::fragment);
+    break;
+
+  case ShaderType::compute:
+    builder.addFile(mName, ShaderBuilder::compute);
     break;
   }
-  mProgram = builder.build();
 
-  gl->glBindFragDataLocation(mProgram, 0, "FragColor");
-  gl->glBindFragDataLocation(mProgram, 1, "FragNormal");
-  //gl->glBindFragDataLocation(mProgram, 2, "FragDepth");
+  if (source)
+    *source = builder.source();
+
+  return builder.build();
 }
 
-Shader::UniformProxy Shader::uniform(const std::string &name)
+Shader::Variant &Shader::compile(uint64_t key, const std::string &defines)
 {
-  auto loc = gl->glGetUniformLocation(mProgram, name.c_str());
+  auto &variant = mVariants[key];
+  variant.program = build(defines);
+
+  refresh(variant);
 
-  if (loc < 0) {
-    //println("Warning: Couldn't get uniform location \"{}\" in shader \"{}\"", name, mName);
-    return {*this, -1};
+  for (const auto &block : mBlocks) {
+    if (!block.second(variant.program))
+      println("Warning: Couldn't find block \"{}\" in shader \"{}\"", block.first, mName);
   }
 
-  return {*this, loc};
+  return variant;
 }
 
-void Shader::use() const
+void Shader::load(const std::string &name, ShaderType type)
+{
+  PROFILE_ZONE("Shader::load");
+  println("Loading shader: {}", name);
+
+  for (auto &variant : mVariants)
+    gl->glDeleteProgram(variant.second.program);
+
+  mVariants.clear();
+  mActive = nullptr;
+  mUniforms.clear();
+  mBlocks.clear();
+  mName = name;
+  mType = type;
+
+  // The generic program takes the defaults for every feature
+  std::string source;
+  mKey = featureKey({}, ~0u);
+  mProgram = build("", &source);
+  mActive = &mVariants[mKey];
+  mActive->program = mProgram;
+  mFeatureMask = featureMask(source);
+}
+
+bool Shader::select(const ShaderFeatures &features)
 {
-  gl->glUseProgram(mProgram);
+  auto key = featureKey(features, mFeatureMask);
+  if (key == mKey)
+    return false;
+
+  auto it = mVariants.find(key);
+  if (it != mVariants.end()) {
+    mActive = &it->second;
+    refresh(*mActive);
+  } else {
+    auto defines = featureDefines(features, mFeatureMask);
+    println("Compiling shader variant: {}\n{}", mName, defines);
+    mActive = &compile(key, defines);
+  }
+
+  mProgram = mActive->program;
+
+  mKey = key;
+  return true;
 }
 
-void Shader::UniformProxy::assertType(GLenum pType)
+Shader::Location Shader::locate(GLuint program, const std::string &name)
 {
-  char name[256];
+  auto loc = gl->glGetUniformLocation(program, name.c_str());
+  if (loc < 0)
+    return { -1, 0, true };
+
+  // Locations and active uniform indices are different things
+  GLuint index;
+  const char *namePtr = name.c_str();
+  gl->glGetUniformIndices(program, 1, &namePtr, &index);
+
+  char activeName[256];
   GLenum type;
   GLint size;
+  gl->glGetActiveUniform(program, index, sizeof(activeName), nullptr, &size, &type, activeName);
 
-  gl->glGetActiveUniform(mProgram.mProgram, mLoc, 256, nullptr, &size, &type, name);
+  return { loc, type, true };
+}
 
-  if (type != pType)
+void Shader::apply(Variant &variant, size_t slot)
+{
+  const auto &uniform = mUniforms[slot];
+  if (variant.locations.size() <= slot) {
+    variant.locations.resize(mUniforms.size());
+    variant.versions.resize(mUniforms.size());
+  }
+
+  auto &location = variant.locations[slot];
+  if (!location.resolved)
+    location = locate(variant.program, _slotNames()[slot]);
+
+  variant.versions[slot] = uniform.version;
+  if (location.loc < 0)
+    return;
+
+  if (location.type != uniform.type)
     fatal("Error assigning to uniform \"{}\" in shader \"{}\":\n  GLSL: {}\n  C++:  {}",
-          name, mProgram.name(), Debug::GlslType(type), Debug::GlslType(pType));
+          _slotNames()[slot], mName, Debug::GlslType(location.type), Debug::GlslType(uniform.type));
+
+  uniform.set(variant.program, location.loc, uniform.data);
+}
+
+void Shader::refresh(Variant &variant)
+{
+  for (size_t slot = 0; slot < mUniforms.size(); ++slot) {
+    if (!mUniforms[slot].set)
+      continue;
+
+    if (slot >= variant.versions.size() || variant.versions[slot] != mUniforms[slot].version)
+      apply(variant, slot);
+  }
+}
+
+Shader::Uniform &Shader::uniformAt(size_t slot)
+{
+  if (mUniforms.size() <= slot)
+    mUniforms.resize(slot + 1);
+
+  return mUniforms[slot];
+}
+
+void Shader::changed(size_t slot)
+{
+  mUniforms[slot].version = ++mVersion;
+  if (mActive)
+    apply(*mActive, slot);
+}
+
+size_t Shader::slot(const std::string &name)
+{
+  auto &slots = _slots();
+  auto it = slots.find(name);
+  if (it != slots.end())
+    return it->second;
+
+  auto &names = _slotNames();
+  names.push_back(name);
+  slots.emplace(name, names.size() - 1);
+  return names.size() - 1;
+}
+
+void Shader::setBlock(const std::string &name, std::function<bool(GLuint)> bind)
+{
+  for (auto &variant : mVariants) {
+    if (!bind(variant.second.program))
+      println("Warning: Couldn't find block \"{}\" in shader \"{}\"", name, mName);
+  }
+
+  mBlocks[name] = std::move(bind);
+}
+
+Shader::UniformProxy Shader::uniform(const std::string &name)
+{
+  return {*this, slot(name)};
+}
+
+Shader::UniformProxy Shader::uniform(size_t slot)
+{
+  return {*this, slot};
+}
+
+void Shader::use() const
+{
+  RenderStats::useProgram(mProgram);
 }
@@ -1,9 +1,14 @@
 #ifndef __INF251_SHADER__21548889
 #define __INF251_SHADER__21548889
 
+#include <cstring>
+#include <functional>
+#include <map>
+#include <vector>
 #include "infdef.hh"
 #include "ShaderStorage.hh"
 #include "Texture.hh"
+#include "TextureArray.hh"
 
 enum struct ShaderType {
   // Load shaders in the same manner as we did before
@@ -17,6 +22,10 @@ enum struct ShaderType {
   // Post processing. Drawn as a quad.
   // Fragment shader.
   postprocess,
+
+  // General purpose, dispatched with glDispatchCompute.
+  // Compute shader.
+  compute,
 };
 
 template <class T>
@@ -32,6 +41,7 @@ struct GlslTypeinfo;
     }
 
 __GLSLASSIGN(Sampler2D, GL_SAMPLER_2D, Uniform1i, val.index);
+__GLSLASSIGN(Sampler2DArray, GL_SAMPLER_2D_ARRAY, Uniform1i, val.index);
 __GLSLASSIGN(GLfloat, GL_FLOAT, Uniform1f, val);
 __GLSLASSIGN(GLdouble, GL_DOUBLE, Uniform1d, val);
 __GLSLASSIGN(GLuint, GL_UNSIGNED_INT, Uniform1i, val);
@@ -39,38 +49,118 @@ __GLSLASSIGN(GLint, GL_INT, Uniform1i, val);
 __GLSLASSIGN(glm::vec2, GL_FLOAT_VEC2, Uniform2f, val.x, val.y);
 __GLSLASSIGN(glm::vec3, GL_FLOAT_VEC3, Uniform3f, val.x, val.y, val.z);
 __GLSLASSIGN(glm::vec4, GL_FLOAT_VEC4, Uniform4f, val.x, val.y, val.z, val.w);
+__GLSLASSIGN(glm::ivec2, GL_INT_VEC2, Uniform2i, val.x, val.y);
+__GLSLASSIGN(glm::ivec3, GL_INT_VEC3, Uniform3i, val.x, val.y, val.z);
 __GLSLASSIGN(glm::mat2, GL_FLOAT_MAT2, UniformMatrix2fv, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&val));
 __GLSLASSIGN(glm::mat3, GL_FLOAT_MAT3, UniformMatrix3fv, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&val));
 __GLSLASSIGN(glm::mat4, GL_FLOAT_MAT4, UniformMatrix4fv, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&val));
 
 #undef __GLSLASSIGN
 
+/// Compile-time switches for shader permutations. Features left at -1 fall
+/// back to the defaults in the shader source.
+struct ShaderFeatures {
+    int texture = -1;
+    int bump = -1;
+
+    // Number of active lights of each type. Permutations only differ in
+    // whether a type has any.
+    int directionalLights = -1;
+    int pointLights = -1;
+    int spotLights = -1;
+};
+
 class Shader {
+    struct Location {
+        GLint loc;
+        GLenum type;
+        bool resolved;
+    };
+
+    struct Variant {
+        GLuint program;
+
+        // By uniform slot: the location, looked up on first use, and the
+        // version of the value last set on this program
+        std::vector<Location> locations;
+        std::vector<uint64_t> versions;
+    };
+
+    // A value kept as raw bytes, so that setting a uniform never allocates.
+    // Large enough for a mat4.
+    struct Uniform {
+        GLenum type = 0;
+        void (*set)(GLuint program, GLint loc, const void *data) = nullptr;
+        uint64_t version = 0;
+        alignas(8) unsigned char data[64];
+    };
+
+    // Compiled permutations, keyed by their packed features
+    std::map<uint64_t, Variant> mVariants;
+    Variant *mActive = nullptr;
+    uint64_t mKey = 0;
     uint32_t mProgram = 0;
+
+    // The features the source tests for. Others never split off a variant.
+    unsigned mFeatureMask = 0;
+
+    // Uniform values by slot, and block bindings. Values are set on the
+    // current variant right away, and on the others when they are selected.
+    std::vector<Uniform> mUniforms;
+    uint64_t mVersion = 0;
+    std::map<std::string, std::function<bool(GLuint)>> mBlocks;
+
     std::string mName = "";
+    ShaderType mType = ShaderType::custom;
 
-    class UniformProxy {
-        const Shader& mProgram;
-        const GLint mLoc;
+    static Location locate(GLuint program, const std::string &name);
+
+    GLuint build(const std::string &defines, std::string *source = nullptr);
+
+    Variant &compile(uint64_t key, const std::string &defines);
+
+    void apply(Variant &variant, size_t slot);
 
-        void assertType(GLenum type);
+    /// Brings a variant up to date with the values set since it was last
+    /// current
+    void refresh(Variant &variant);
+
+    Uniform &uniformAt(size_t slot);
+
+    void changed(size_t slot);
+
+    template <class T>
+    static void setValue(GLuint program, GLint loc, const void *data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        GlslTypeinfo<T>::setUniform(program, loc, value);
+    }
+
+    void setBlock(const std::string &name, std::function<bool(GLuint)> bind);
+
+    class UniformProxy {
+        Shader &mShader;
+        size_t mSlot;
 
     public:
-        UniformProxy(const Shader& program, const GLint loc):
-            mProgram(program),
-            mLoc(loc)
+        UniformProxy(Shader &shader, size_t slot):
+            mShader(shader),
+            mSlot(slot)
         {
         }
 
         template <class T>
         UniformProxy& operator=(const T &value)
         {
-            using type = GlslTypeinfo<typename std::decay<T>::type>;
-            if (mLoc >= 0)
-            {
-                assertType(type::glslEnum);
-                type::setUniform(mProgram.mProgram, mLoc, value);
-            }
+            using type = typename std::decay<T>::type;
+            static_assert(sizeof(type) <= sizeof(Uniform::data), "Uniform value too large");
+
+            auto &uniform = mShader.uniformAt(mSlot);
+            uniform.type = GlslTypeinfo<type>::glslEnum;
+            uniform.set = &setValue<type>;
+            std::memcpy(uniform.data, &value, sizeof(type));
+            mShader.changed(mSlot);
 
             return *this;
         }
@@ -96,10 +186,22 @@ public:
         return mName;
     }
 
+    /// Compiles the generic program. Permutations are compiled on demand by
+    /// select().
     void load(const std::string &name, ShaderType type = ShaderType::custom);
 
+    /// Makes the permutation for the given features current, compiling it if
+    /// needed. Returns true if the current program changed.
+    bool select(const ShaderFeatures &features);
+
+    /// Number of a uniform name, the same in every shader. Callers that set
+    /// a uniform every draw can look it up once and pass the slot instead.
+    static size_t slot(const std::string &name);
+
     UniformProxy uniform(const std::string &name);
 
+    UniformProxy uniform(size_t slot);
+
     void use() const;
 
     operator bool() const
@@ -107,26 +209,38 @@ public:
         return mProgram != 0;
     }
 
-    template <class T, size_t N>
-    void bindBuffer(const ShaderStorage<T, N> &ub)
+    template <class T, size_t N, class Kind>
+    void bindBuffer(const ShaderStorage<T, N, Kind> &ub)
     {
         ub.bind();
-        auto loc = gl->glGetProgramResourceIndex(mProgram, GL_SHADER_STORAGE_BLOCK, ub.name);
-        if (loc < 0)
-            fatal("Warning: Couldn't find shader storage block \"{}\" in shader \"{}\"", mName, ub.name);
 
-        gl->glShaderStorageBlockBinding(mProgram, loc, ub.binding);
-    }
+        const char *name = ub.name;
+        if (mBlocks.count(name))
+            return;
 
-    void unbindBuffer(GLuint binding)
-    {
-        gl->glShaderStorageBlockBinding(mProgram, 0, binding);
+        auto binding = ub.binding;
+        setBlock(name, [name, binding](GLuint program) {
+            // Blocks the shader doesn't use are optimised out by the linker
+            auto index = Kind::blockIndex(program, name);
+            if (index == GL_INVALID_INDEX)
+                return false;
+
+            Kind::blockBinding(program, index, binding);
+            return true;
+        });
     }
 
-    template <class T, size_t N>
-    void unbindBuffer(const ShaderStorage<T, N> &ub)
+    /// Stops binding the buffer's block, and resets it to binding 0 in the
+    /// variants compiled so far
+    template <class T, size_t N, class Kind>
+    void unbindBuffer(const ShaderStorage<T, N, Kind> &ub)
     {
-        unbindBuffer(ub.binding);
+        mBlocks.erase(ub.name);
+        for (auto &variant : mVariants) {
+            auto index = Kind::blockIndex(variant.second.program, ub.name);
+            if (index != GL_INVALID_INDEX)
+                Kind::blockBinding(variant.second.program, index, 0);
+        }
     }
 };
 
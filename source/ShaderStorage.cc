@@ -0,0 +1,142 @@
+#include <cstring>
+#include "ShaderStorage.hh"
+#include "RenderStats.hh"
+
+namespace {
+  // Bumped once per rendered frame by Storage::nextFrame
+  uint64_t _frame = 1;
+
+  // Generous enough that a triple-buffered ring never waits in practice
+  constexpr GLuint64 FENCE_TIMEOUT = 1000000000;
+}
+
+void Storage::nextFrame()
+{
+  _frame++;
+}
+
+uint64_t Storage::frame()
+{
+  return _frame;
+}
+
+void Storage::countUpload(size_t bytes)
+{
+  RenderStats::add(RenderStats::UPLOAD_BYTES, bytes);
+}
+
+size_t Storage::uploadedBytes()
+{
+  return RenderStats::last(RenderStats::UPLOAD_BYTES);
+}
+
+StreamingRing::StreamingRing(GLenum target, GLsizeiptr blockSize, GLsizeiptr slotsPerFrame) :
+  mTarget(target),
+  mBlockSize(blockSize),
+  mSlots(slotsPerFrame)
+{
+  GLint alignment = 1;
+  gl->glGetIntegerv(target == GL_UNIFORM_BUFFER
+                    ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+                    : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                    &alignment);
+
+  // Every slot must start at an offset the implementation can bind
+  mStride = (mBlockSize + alignment - 1) / alignment * alignment;
+  mFrame = Storage::frame();
+
+  allocate();
+}
+
+StreamingRing::~StreamingRing()
+{
+  for (auto &fence : mFences) {
+    if (fence)
+      gl->glDeleteSync(fence);
+  }
+
+  if (mBuffer)
+    gl->glDeleteBuffers(1, &mBuffer);
+}
+
+void StreamingRing::allocate()
+{
+  // Regions of the old buffer may still be in flight, but GL keeps a deleted
+  // buffer alive until the commands referencing it are done
+  if (mBuffer)
+    gl->glDeleteBuffers(1, &mBuffer);
+
+  for (auto &fence : mFences) {
+    if (fence) {
+      gl->glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  gl->glGenBuffers(1, &mBuffer);
+  gl->glBindBuffer(mTarget, mBuffer);
+  gl->glBufferData(mTarget, mStride * mSlots * REGIONS, nullptr, GL_STREAM_DRAW);
+
+  mRegion = 0;
+  mSlot = 0;
+  mOffset = 0;
+}
+
+void StreamingRing::advance()
+{
+  // Everything issued so far, including the draws reading the current
+  // region, is covered by this fence
+  if (mSlot > 0) {
+    if (mFences[mRegion])
+      gl->glDeleteSync(mFences[mRegion]);
+    mFences[mRegion] = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mRegion = (mRegion + 1) % REGIONS;
+    mSlot = 0;
+  }
+
+  // The region we're about to overwrite was last used REGIONS frames ago
+  if (mFences[mRegion]) {
+    auto status = gl->glClientWaitSync(mFences[mRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      println(stderr, "Warning: streaming buffer waited on the GPU");
+      gl->glClientWaitSync(mFences[mRegion], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+    }
+    gl->glDeleteSync(mFences[mRegion]);
+    mFences[mRegion] = nullptr;
+  }
+}
+
+void StreamingRing::write(const void *data)
+{
+  if (mFrame != Storage::frame()) {
+    advance();
+    mFrame = Storage::frame();
+  }
+
+  // More updates in a single frame than the ring was sized for
+  if (mSlot == mSlots) {
+    mSlots *= 2;
+    allocate();
+  }
+
+  auto offset = (mRegion * mSlots + mSlot) * mStride;
+
+  gl->glBindBuffer(mTarget, mBuffer);
+  auto ptr = gl->glMapBufferRange(mTarget, offset, mBlockSize,
+                                  GL_MAP_WRITE_BIT
+                                  | GL_MAP_INVALIDATE_RANGE_BIT
+                                  | GL_MAP_UNSYNCHRONIZED_BIT);
+  if (!ptr)
+    fatal("Couldn't map streaming buffer range at offset {}", offset);
+
+  std::memcpy(ptr, data, mBlockSize);
+  gl->glUnmapBuffer(mTarget);
+
+  mOffset = offset;
+  mSlot++;
+}
+
+void StreamingRing::bind(GLuint binding) const
+{
+  gl->glBindBufferRange(mTarget, binding, mBuffer, mOffset, mBlockSize);
+}
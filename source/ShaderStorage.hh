@@ -1,19 +1,147 @@
 #ifndef __INF251_SHADERSTORAGE__31298117
 #define __INF251_SHADERSTORAGE__31298117
 
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
 #include "infdef.hh"
 
-template <class Block, size_t = 1>
+namespace Storage {
+  // Marks the end of a frame. Streaming rings fence the regions written
+  // before this call.
+  void nextFrame();
+
+  // Current frame number, as advanced by nextFrame
+  uint64_t frame();
+
+  // Adds to the number of bytes uploaded during the current frame, kept
+  // with the other RenderStats counters
+  void countUpload(size_t bytes);
+
+  // Bytes uploaded by all ShaderStorage updates during the last frame
+  size_t uploadedBytes();
+}
+
+// Buffer kind policies. Both expose the GL target and the GLSL declaration
+// used for READONLY_BLOCK in shaders.
+//
+// Nothing here can check that a C++ block mirrors its GLSL declaration:
+// vec3 members need alignas(16), scalars may follow a vec3 in its last four
+// bytes, and std140 pads scalar and vec2 array elements to a vec4. Each block
+// asserts its own offsets with offsetof next to its definition.
+struct StorageBuffer {
+    static constexpr GLenum target = GL_SHADER_STORAGE_BUFFER;
+
+    static const char *declaration()
+    {
+        return "layout(std430, binding = b) buffer";
+    }
+
+    static GLuint blockIndex(GLuint program, const char *name)
+    {
+        return gl->glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name);
+    }
+
+    static void blockBinding(GLuint program, GLuint index, GLuint binding)
+    {
+        gl->glShaderStorageBlockBinding(program, index, binding);
+    }
+};
+
+struct UniformBuffer {
+    static constexpr GLenum target = GL_UNIFORM_BUFFER;
+
+    static const char *declaration()
+    {
+        return "layout(std140, binding = b) uniform";
+    }
+
+    static GLuint blockIndex(GLuint program, const char *name)
+    {
+        return gl->glGetUniformBlockIndex(program, name);
+    }
+
+    static void blockBinding(GLuint program, GLuint index, GLuint binding)
+    {
+        gl->glUniformBlockBinding(program, index, binding);
+    }
+};
+
+// Kind used for the small blocks that shaders only read. Uniform buffers
+// usually take the constant cache path; the grieg-ssbo target is built with
+// GRIEG_SSBO_BLOCKS for comparing against shader storage buffers. No numbers
+// have been recorded yet, so the default is the common wisdom only.
+#ifdef GRIEG_SSBO_BLOCKS
+using ReadOnlyBuffer = StorageBuffer;
+#else
+using ReadOnlyBuffer = UniformBuffer;
+#endif
+
+enum struct StorageMode {
+    // A single buffer, updated in place with glBufferSubData
+    dynamic,
+
+    // A fenced ring of buffer regions, one per frame in flight, written with
+    // unsynchronised maps and bound by offset. Use for blocks that are
+    // updated several times per frame.
+    streaming,
+};
+
+class StreamingRing {
+    static constexpr int REGIONS = 3;
+
+    const GLenum mTarget;
+    const GLsizeiptr mBlockSize;
+    GLsizeiptr mStride {};
+    GLsizeiptr mSlots;
+
+    GLuint mBuffer {};
+    GLsync mFences[REGIONS] {};
+    int mRegion {};
+    GLsizeiptr mSlot {};
+    GLintptr mOffset {};
+    uint64_t mFrame {};
+
+    void allocate();
+    void advance();
+
+public:
+    StreamingRing(GLenum target, GLsizeiptr blockSize, GLsizeiptr slotsPerFrame = 64);
+
+    StreamingRing(const StreamingRing&) = delete;
+
+    ~StreamingRing();
+
+    StreamingRing& operator=(const StreamingRing&) = delete;
+
+    GLuint buffer() const
+    {
+        return mBuffer;
+    }
+
+    void write(const void *data);
+
+    void bind(GLuint binding) const;
+};
+
+template <class Block, size_t = 1, class Kind = StorageBuffer>
 class ShaderStorage {
+    static_assert(std::is_trivially_copyable<Block>::value,
+                  "Shader blocks are uploaded and compared bytewise");
+
     Block mBlock {};
     GLuint mSsbo {};
+    StorageMode mMode = StorageMode::dynamic;
+    std::unique_ptr<StreamingRing> mRing {};
 
     void init()
     {
         if (!mSsbo) {
             gl->glGenBuffers(1, &mSsbo);
-            gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSsbo);
-            gl->glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(mBlock), &mBlock, GL_DYNAMIC_DRAW);
+            gl->glBindBuffer(Kind::target, mSsbo);
+            gl->glBufferData(Kind::target, sizeof(mBlock), &mBlock, GL_DYNAMIC_DRAW);
         }
     }
 
@@ -23,6 +151,11 @@ public:
 
     ShaderStorage() = default;
 
+    explicit ShaderStorage(StorageMode mode):
+        mMode(mode)
+    {
+    }
+
     ShaderStorage(const ShaderStorage&) = delete;
 
     ShaderStorage(ShaderStorage&&) = default;
@@ -85,34 +218,69 @@ public:
 
     GLuint buffer() const
     {
-        return mSsbo;
+        return mRing ? mRing->buffer() : mSsbo;
     }
 
     void bind() const
     {
-        gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, mSsbo);
+        if (mRing)
+            mRing->bind(binding);
+        else
+            gl->glBindBufferBase(Kind::target, binding, mSsbo);
     }
 
     void update()
     {
+        if (mMode == StorageMode::streaming) {
+            if (!mRing)
+                mRing.reset(new StreamingRing(Kind::target, sizeof(mBlock)));
+            mRing->write(&mBlock);
+            Storage::countUpload(sizeof(mBlock));
+            bind();
+            return;
+        }
+
         init();
         bind();
-        gl->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(mBlock), &mBlock);
+        gl->glBufferSubData(Kind::target, 0, sizeof(mBlock), &mBlock);
+        Storage::countUpload(sizeof(mBlock));
     }
 };
 
-template <class Block, size_t N>
-class ShaderStorage<Block[], N> {
+template <class Block, size_t N, class Kind>
+class ShaderStorage<Block[], N, Kind> {
+    static_assert(std::is_trivially_copyable<Block>::value,
+                  "Shader blocks are uploaded and compared bytewise");
+    // std140 rounds the stride of array elements up to a vec4
+    static_assert(!std::is_same<Kind, UniformBuffer>::value || sizeof(Block) % 16 == 0,
+                  "Array element stride doesn't match std140");
+
     Block mBlock[N] {};
+
+    // Contents as last uploaded, so that update() only sends what changed
+    Block mUploaded[N] {};
+
     GLuint mSsbo {};
+    StorageMode mMode = StorageMode::dynamic;
+    std::unique_ptr<StreamingRing> mRing {};
 
-    void init()
+    bool init()
     {
         if (!mSsbo) {
             gl->glGenBuffers(1, &mSsbo);
-            gl->glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSsbo);
-            gl->glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(mBlock), mBlock, GL_DYNAMIC_DRAW);
+            gl->glBindBuffer(Kind::target, mSsbo);
+            gl->glBufferData(Kind::target, sizeof(mBlock), mBlock, GL_DYNAMIC_DRAW);
+            std::memcpy(mUploaded, mBlock, sizeof(mBlock));
+            Storage::countUpload(sizeof(mBlock));
+            return true;
         }
+
+        return false;
+    }
+
+    bool dirty(size_t idx) const
+    {
+        return std::memcmp(&mBlock[idx], &mUploaded[idx], sizeof(Block)) != 0;
     }
 
 public:
@@ -121,6 +289,11 @@ public:
 
     ShaderStorage() = default;
 
+    explicit ShaderStorage(StorageMode mode):
+        mMode(mode)
+    {
+    }
+
     ShaderStorage(const ShaderStorage&) = delete;
 
     ShaderStorage(ShaderStorage&&) = default;
@@ -145,6 +318,127 @@ public:
         return mBlock[idx];
     }
 
+    GLuint buffer() const
+    {
+        return mRing ? mRing->buffer() : mSsbo;
+    }
+
+    void bind() const
+    {
+        if (mRing)
+            mRing->bind(binding);
+        else
+            gl->glBindBufferBase(Kind::target, binding, mSsbo);
+    }
+
+    // Uploads the elements that changed since the last update, coalesced
+    // into contiguous ranges. Nothing is sent when the array is clean.
+    void update()
+    {
+        if (mMode == StorageMode::streaming) {
+            if (!mRing) {
+                mRing.reset(new StreamingRing(Kind::target, sizeof(mBlock)));
+            } else if (std::memcmp(mBlock, mUploaded, sizeof(mBlock)) == 0) {
+                bind();
+                return;
+            }
+
+            // A ring slot has to hold the whole array
+            mRing->write(mBlock);
+            std::memcpy(mUploaded, mBlock, sizeof(mBlock));
+            Storage::countUpload(sizeof(mBlock));
+            bind();
+            return;
+        }
+
+        if (init()) {
+            bind();
+            return;
+        }
+
+        bind();
+        size_t idx = 0;
+        while (idx < N) {
+            if (!dirty(idx)) {
+                idx++;
+                continue;
+            }
+
+            size_t first = idx;
+            while (idx < N && dirty(idx))
+                idx++;
+
+            auto offset = first * sizeof(Block);
+            auto size = (idx - first) * sizeof(Block);
+            gl->glBufferSubData(Kind::target, offset, size, &mBlock[first]);
+            std::memcpy(&mUploaded[first], &mBlock[first], size);
+            Storage::countUpload(size);
+        }
+    }
+};
+
+// Runtime-sized array, mirroring an unsized array at the end of a GLSL
+// block. The buffer is bound with the exact element count, so shaders can
+// rely on .length(). Resizing invalidates references to the elements.
+template <class Block, class Kind>
+class ShaderStorage<Block[], 0, Kind> {
+    static_assert(std::is_same<Kind, StorageBuffer>::value,
+                  "Only shader storage buffers can hold runtime-sized arrays");
+    static_assert(std::is_trivially_copyable<Block>::value,
+                  "Shader blocks are uploaded and compared bytewise");
+
+    std::vector<Block> mBlocks {};
+
+    // Contents as last uploaded, so that update() only sends what changed
+    std::vector<Block> mUploaded {};
+
+    GLuint mSsbo {};
+
+    bool dirty(size_t idx) const
+    {
+        return std::memcmp(&mBlocks[idx], &mUploaded[idx], sizeof(Block)) != 0;
+    }
+
+public:
+    static constexpr auto name = Block::name;
+    static constexpr auto binding = Block::binding;
+
+    ShaderStorage() = default;
+
+    ShaderStorage(const ShaderStorage&) = delete;
+
+    ShaderStorage(ShaderStorage&&) = default;
+
+    ~ShaderStorage()
+    {
+        if (mSsbo)
+            gl->glDeleteBuffers(1, &mSsbo);
+    }
+
+    ShaderStorage& operator=(const ShaderStorage&) = delete;
+
+    ShaderStorage& operator=(ShaderStorage&&) = default;
+
+    Block& operator[](size_t idx)
+    {
+        return mBlocks[idx];
+    }
+
+    const Block& operator[](size_t idx) const
+    {
+        return mBlocks[idx];
+    }
+
+    size_t size() const
+    {
+        return mBlocks.size();
+    }
+
+    void resize(size_t size)
+    {
+        mBlocks.resize(size);
+    }
+
     GLuint buffer() const
     {
         return mSsbo;
@@ -152,14 +446,47 @@ public:
 
     void bind() const
     {
-        gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, mSsbo);
+        if (!mBlocks.empty())
+            gl->glBindBufferRange(Kind::target, binding, mSsbo, 0, mBlocks.size() * sizeof(Block));
     }
 
+    // Reallocates when the array grew, otherwise uploads only the changed
+    // elements, like the fixed-size array
     void update()
     {
-        init();
+        if (mBlocks.empty())
+            return;
+
+        if (!mSsbo)
+            gl->glGenBuffers(1, &mSsbo);
+
+        if (mUploaded.size() != mBlocks.size()) {
+            gl->glBindBuffer(Kind::target, mSsbo);
+            gl->glBufferData(Kind::target, mBlocks.size() * sizeof(Block), mBlocks.data(), GL_DYNAMIC_DRAW);
+            mUploaded = mBlocks;
+            Storage::countUpload(mBlocks.size() * sizeof(Block));
+            bind();
+            return;
+        }
+
         bind();
-        gl->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(mBlock), mBlock);
+        size_t idx = 0;
+        while (idx < mBlocks.size()) {
+            if (!dirty(idx)) {
+                idx++;
+                continue;
+            }
+
+            size_t first = idx;
+            while (idx < mBlocks.size() && dirty(idx))
+                idx++;
+
+            auto offset = first * sizeof(Block);
+            auto size = (idx - first) * sizeof(Block);
+            gl->glBufferSubData(Kind::target, offset, size, &mBlocks[first]);
+            std::memcpy(&mUploaded[first], &mBlocks[first], size);
+            Storage::countUpload(size);
+        }
     }
 };
 #endif //__INF251_SHADERSTORAGE__31298117
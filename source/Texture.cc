@@ -1,6 +1,9 @@
 #include <chrono>
 #include <QImage>
 #include "Texture.hh"
+#include "Assets.hh"
+#include "Profiler.hh"
+#include "RenderStats.hh"
 
 namespace {
   using _clock = std::chrono::steady_clock;
@@ -28,15 +31,18 @@ void Texture::init(int numFrames) {
 
 void Texture::load(const std::string & name, int numFrames) {
   assert(numFrames > 0);
+  PROFILE_ZONE("Texture::load");
 
   println("Loading texture: {} with {} frames", name, numFrames);
 
-  auto path = format("resources/textures/{}", name);
-  auto surface = QImage(QString::fromStdString(path));
+  QImage surface;
+  {
+    PROFILE_ZONE("decode");
+    surface = Assets::decodeImage(format("resources/textures/{}", name));
+  }
 
   if (surface.isNull()) { fatal("  Could not load texture: {}", name); }
 
-  println("  format:         {}", surface.format());
   if (numFrames > 1) {
     println("  width:          {} ({} per frame)", surface.width(), surface.width() / numFrames);
   } else {
@@ -44,13 +50,6 @@ void Texture::load(const std::string & name, int numFrames) {
   }
   println("  height:         {}", surface.height());
 
-  {
-    auto rgbSurface = surface.convertToFormat(QImage::Format_RGB888);
-      if (rgbSurface.isNull())
-      fatal("  Could not convert surface to RGBA: {}", name);
-    surface = rgbSurface;
-  }
-
   init(numFrames);
 
   auto frameHeight = surface.height() / mNumFrames;
@@ -82,4 +81,5 @@ void Texture::bind(Sampler2D sampler) {
 
   gl->glActiveTexture(GL_TEXTURE0 + sampler.index);
   gl->glBindTexture(GL_TEXTURE_2D, mTextures[mFrame]);
+  RenderStats::add(RenderStats::TEXTURE_BINDS);
 }
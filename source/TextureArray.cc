@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <QImage>
+#include "TextureArray.hh"
+#include "RenderStats.hh"
+
+namespace {
+  constexpr int MIN_BUCKET = 256;
+  constexpr int MAX_BUCKET = 1024;
+}
+
+TextureArray::~TextureArray() {
+  if (mTexture) {
+    gl->glDeleteTextures(1, &mTexture);
+  }
+}
+
+TextureArray::TextureArray(TextureArray &&other) :
+  mTexture(other.mTexture),
+  mSize(other.mSize),
+  mLayers(other.mLayers)
+{
+  other.mTexture = 0;
+  other.mSize = 0;
+  other.mLayers = 0;
+}
+
+TextureArray& TextureArray::operator=(TextureArray &&other) {
+  std::swap(mTexture, other.mTexture);
+  std::swap(mSize, other.mSize);
+  std::swap(mLayers, other.mLayers);
+  return *this;
+}
+
+int TextureArray::bucketSize(int width, int height) {
+  // Round the larger side to the nearest power of two in
+  // [MIN_BUCKET, MAX_BUCKET]. Between the two, resampling never distorts a
+  // texture by more than a factor of two; textures outside the range are
+  // scaled to the nearest end of it, however far that is.
+  int side = std::max(width, height);
+  int size = MIN_BUCKET;
+  while (size < MAX_BUCKET && size + size / 2 < side) {
+    size *= 2;
+  }
+
+  return size;
+}
+
+void TextureArray::load(const std::vector<std::string> &names, int size) {
+  assert(!names.empty() && size > 0);
+
+  println("Loading texture array: {} layers of {}x{}", names.size(), size, size);
+
+  if (mTexture) {
+    gl->glDeleteTextures(1, &mTexture);
+  }
+
+  mSize = size;
+  mLayers = static_cast<int>(names.size());
+
+  int levels = 1;
+  while ((size >> levels) > 0) {
+    levels++;
+  }
+
+  gl->glGenTextures(1, &mTexture);
+  gl->glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+  gl->glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGB8, mSize, mSize, mLayers);
+
+  for (int i = 0; i < mLayers; i++) {
+    auto path = format("resources/textures/{}", names[i]);
+    auto surface = QImage(QString::fromStdString(path));
+
+    if (surface.isNull()) { fatal("  Could not load texture: {}", names[i]); }
+
+    println("  layer {}:        {} ({}x{})", i, names[i], surface.width(), surface.height());
+
+    if (surface.width() != mSize || surface.height() != mSize) {
+      surface = surface.scaled(mSize, mSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    surface = surface.convertToFormat(QImage::Format_RGB888);
+    if (surface.isNull())
+      fatal("  Could not convert surface to RGB: {}", names[i]);
+
+    gl->glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                        0, /* mipmap level */
+                        0, /* x-offset */
+                        0, /* y-offset */
+                        i, /* layer */
+                        mSize,
+                        mSize,
+                        1,
+                        GL_RGB,
+                        GL_UNSIGNED_BYTE,
+                        surface.bits());
+  }
+
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  gl->glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+void TextureArray::bind(Sampler2DArray sampler) {
+  gl->glActiveTexture(GL_TEXTURE0 + sampler.index);
+  gl->glBindTexture(GL_TEXTURE_2D_ARRAY, mTexture);
+  RenderStats::add(RenderStats::TEXTURE_BINDS);
+}
@@ -0,0 +1,66 @@
+#ifndef __INF251_TEXTUREARRAY__20937514
+#define __INF251_TEXTUREARRAY__20937514
+
+#include <vector>
+#include "infdef.hh"
+
+struct Sampler2DArray {
+  GLuint index;
+
+  constexpr Sampler2DArray(GLuint pIndex) :
+    index(pIndex) {}
+
+  Sampler2DArray& operator=(GLuint pIndex) {
+    index = pIndex;
+    return *this;
+  }
+
+  explicit operator GLuint() const {
+    return index;
+  }
+};
+
+class TextureArray;
+using TextureArrayPtr = std::shared_ptr<TextureArray>;
+
+/// A square GL_TEXTURE_2D_ARRAY where every layer is one texture file
+///
+/// Images that don't match the array's size are resampled on load, so a
+/// single bind serves every material that lives in the array
+class TextureArray {
+  GLuint mTexture{};
+  int mSize{};
+  int mLayers{};
+
+public:
+  TextureArray() = default;
+
+  ~TextureArray();
+
+  TextureArray(const TextureArray&) = delete;
+
+  /// Takes over the texture; the source is left empty
+  TextureArray(TextureArray &&other);
+
+  TextureArray& operator=(const TextureArray&) = delete;
+
+  /// Swaps with the source, which releases the old texture when it dies
+  TextureArray& operator=(TextureArray &&other);
+
+  /// Picks the array size a texture of the given dimensions belongs to
+  static int bucketSize(int width, int height);
+
+  /// Loads every file into its own layer, in the given order
+  void load(const std::vector<std::string> &names, int size);
+
+  void bind(Sampler2DArray sampler = 1);
+
+  int size() const {
+    return mSize;
+  }
+
+  int layers() const {
+    return mLayers;
+  }
+};
+#endif //__INF251_TEXTUREARRAY__20937514
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
@@ -7,8 +9,11 @@
 #include <QDesktopWidget>
 #include <QTextStream>
 #include <QSplashScreen>
+#include <QCommandLineParser>
 
 #include "MainWindow.hh"
+#include "Benchmark.hh"
+#include "Profiler.hh"
 
 #ifdef _WIN32
 // Force high performance GPU
@@ -64,6 +69,13 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd) {
   QApplication app(argc, 0);
 #else
 int main(int argc, char * argv[]) {
+  // The benchmark never opens a window, so it doesn't need a display
+  // unless a platform is asked for
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--benchmark") == 0 && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
   QApplication app(argc, argv);
 #endif
 
@@ -76,6 +88,35 @@ int main(int argc, char * argv[]) {
 
   app.setApplicationName("Grieghallen Explorer");
 
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption frameTimesOption("frame-times",
+                                      "Write the recorded frame times to <file> as CSV on exit.",
+                                      "file");
+  parser.addOption(frameTimesOption);
+
+  QCommandLineOption traceOption("trace",
+                                 "Record from startup and write a Chrome trace to <file> on exit.",
+                                 "file");
+  parser.addOption(traceOption);
+
+  QCommandLineOption benchmarkOption("benchmark",
+                                     "Fly through every model and shader mode without a window, "
+                                     "print a JSON summary and exit.");
+  QCommandLineOption framesOption("frames", "Measured frames per benchmark run.", "n", "300");
+  QCommandLineOption sizeOption("size", "Benchmark framebuffer size.", "WxH", "1280x720");
+  QCommandLineOption outputOption("output", "Also write the benchmark summary to <file>.", "file");
+  parser.addOption(benchmarkOption);
+  parser.addOption(framesOption);
+  parser.addOption(sizeOption);
+  parser.addOption(outputOption);
+  parser.process(app);
+
+  if (parser.isSet(traceOption)) {
+    Profiler::setEnabled(true);
+    Profiler::setThreadName("main");
+  }
+
   QSurfaceFormat surfaceFormat;
   surfaceFormat.setDepthBufferSize(24);
   surfaceFormat.setStencilBufferSize(8);
@@ -83,6 +124,31 @@ int main(int argc, char * argv[]) {
   surfaceFormat.setProfile(QSurfaceFormat::CoreProfile);
   QSurfaceFormat::setDefaultFormat(surfaceFormat);
 
+  if (parser.isSet(benchmarkOption)) {
+    BenchmarkOptions options;
+    options.frames = std::max(parser.value(framesOption).toInt(), 1);
+
+    auto size = parser.value(sizeOption).split('x');
+    if (size.size() == 2) {
+      options.width = std::max(size[0].toInt(), 1);
+      options.height = std::max(size[1].toInt(), 1);
+    }
+
+    options.output = parser.value(outputOption).toStdString();
+
+    Renderer renderer;
+    renderer.setFormat(surfaceFormat);
+    gl = &renderer;
+
+    int status = Benchmark(renderer, options).run();
+    if (status == 0 && parser.isSet(frameTimesOption))
+      renderer.frameStats.writeCsv(parser.value(frameTimesOption).toStdString());
+    if (parser.isSet(traceOption))
+      Profiler::writeTrace(parser.value(traceOption).toStdString());
+
+    return status;
+  }
+
   View::MainWindow mainWindow;
   mainWindow.setWindowIcon(QIcon(":images/icon2.png"));
   
@@ -106,5 +172,19 @@ int main(int argc, char * argv[]) {
   
   splash.finish(&mainWindow);
 
+  if (parser.isSet(traceOption)) {
+    auto path = parser.value(traceOption).toStdString();
+    QObject::connect(&app, &QApplication::aboutToQuit, [path]() {
+      Profiler::writeTrace(path);
+    });
+  }
+
+  if (parser.isSet(frameTimesOption)) {
+    auto path = parser.value(frameTimesOption).toStdString();
+    QObject::connect(&app, &QApplication::aboutToQuit, [&renderer, path]() {
+      renderer.frameStats.writeCsv(path);
+    });
+  }
+
   return app.exec();
 }